@@ -0,0 +1,650 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "batch.hpp"
+
+namespace epp
+{
+namespace
+{
+struct BatchJob
+{
+  size_t script;
+  std::optional<uint64_t> seed;
+  size_t inputSet;
+};
+
+// Each worker pops from the back of its own queue and steals from the front of
+// the others, so neighbouring jobs tend to stay on one thread
+class WorkQueue
+{
+public:
+  void push(size_t job)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    jobs.push_back(job);
+  }
+
+  std::optional<size_t> pop()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (jobs.empty())
+    {
+      return std::nullopt;
+    }
+
+    size_t job = jobs.back();
+    jobs.pop_back();
+    return job;
+  }
+
+  std::optional<size_t> steal()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (jobs.empty())
+    {
+      return std::nullopt;
+    }
+
+    size_t job = jobs.front();
+    jobs.pop_front();
+    return job;
+  }
+
+private:
+  std::mutex mutex;
+  std::deque<size_t> jobs;
+};
+
+std::string csvField(const std::string& field)
+{
+  if (field.find_first_of(",\"\n") == std::string::npos)
+  {
+    return field;
+  }
+
+  std::string ret = "\"";
+
+  for (char c : field)
+  {
+    if (c == '"')
+    {
+      ret += '"';
+    }
+
+    ret += c;
+  }
+
+  ret += '"';
+  return ret;
+}
+
+std::string jsonString(const std::string& str)
+{
+  std::ostringstream ret;
+  ret << '"';
+
+  for (char c : str)
+  {
+    switch (c)
+    {
+      case '"':
+        ret << "\\\"";
+        break;
+      case '\\':
+        ret << "\\\\";
+        break;
+      case '\n':
+        ret << "\\n";
+        break;
+      case '\t':
+        ret << "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20)
+        {
+          ret << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+        }
+        else
+        {
+          ret << c;
+        }
+    }
+  }
+
+  ret << '"';
+  return ret.str();
+}
+
+// Every stall is charged to exactly one program, so these are the run totals
+StallCounts stallTotals(const RunStats& stats)
+{
+  StallCounts ret{};
+
+  for (const auto& rPair : stats.programStalls)
+  {
+    for (size_t r = 0; r < ret.size(); r++)
+    {
+      ret[r] += rPair.second[r];
+    }
+  }
+
+  return ret;
+}
+
+void parseSeeds(const std::string& arg, std::vector<uint64_t>& rSeeds)
+{
+  std::istringstream stream(arg);
+  std::string item;
+
+  while (std::getline(stream, item, ','))
+  {
+    size_t dash = item.find('-');
+
+    if (dash == std::string::npos)
+    {
+      rSeeds.push_back(parseCount(item));
+    }
+    else
+    {
+      uint64_t first = parseCount(item.substr(0, dash));
+      uint64_t last = parseCount(item.substr(dash + 1));
+
+      if (last < first)
+      {
+        throw Error("Seed range runs backwards: " + item);
+      }
+
+      for (uint64_t seed = first; ; seed++)
+      {
+        rSeeds.push_back(seed);
+
+        if (seed == last)
+        {
+          break;
+        }
+      }
+    }
+  }
+}
+
+InputSet parseInputSet(const std::string& arg)
+{
+  InputSet ret;
+  std::istringstream stream(arg);
+  std::string item;
+
+  while (std::getline(stream, item, ','))
+  {
+    size_t equals = item.find('=');
+
+    if (equals == std::string::npos)
+    {
+      throw Error("Expected ID=path in input set: " + item);
+    }
+
+    ret[static_cast<uint16_t>(parseCount(item.substr(0, equals), std::numeric_limits<uint16_t>::max()))] = item.substr(equals + 1);
+  }
+
+  return ret;
+}
+} // namespace
+
+std::vector<BatchResult> runBatch(const BatchConfig& config)
+{
+  std::vector<std::shared_ptr<const Script>> scripts;
+  std::vector<std::string> loadErrors;
+
+  for (const auto& rPath : config.scripts)
+  {
+    try
+    {
+      scripts.push_back(std::make_shared<const Script>(rPath));
+      loadErrors.emplace_back();
+    }
+    catch (const std::exception& e)
+    {
+      scripts.emplace_back();
+      loadErrors.emplace_back(e.what());
+    }
+  }
+
+  if (config.writeFiles && !config.inputSets.empty())
+  {
+    throw Error("Cannot write files back with input sets; each run would overwrite its input set's files");
+  }
+
+  // A mistyped ID would otherwise quietly run the script's own file
+  for (size_t script = 0; script < scripts.size(); script++)
+  {
+    if (!scripts[script])
+    {
+      continue;
+    }
+
+    for (size_t inputSet = 0; inputSet < config.inputSets.size(); inputSet++)
+    {
+      for (const auto& rPair : config.inputSets[inputSet])
+      {
+        const auto& rFiles = scripts[script]->files;
+        bool declared = std::any_of(rFiles.begin(), rFiles.end(),
+          [&](const Script::FileSpec& rSpec)
+          {
+            return rSpec.file.id == rPair.first;
+          });
+
+        if (!declared)
+        {
+          throw Error("Input set " + std::to_string(inputSet) + " replaces file " + std::to_string(rPair.first) +
+            ", which " + config.scripts[script].string() + " does not declare");
+        }
+      }
+    }
+  }
+
+  std::vector<std::optional<uint64_t>> seeds(config.seeds.begin(), config.seeds.end());
+  if (seeds.empty())
+  {
+    seeds.emplace_back();
+  }
+
+  size_t inputSetCount = std::max<size_t>(config.inputSets.size(), 1);
+
+  std::vector<BatchJob> jobs;
+
+  for (size_t script = 0; script < scripts.size(); script++)
+  {
+    for (const auto& rSeed : seeds)
+    {
+      for (size_t inputSet = 0; inputSet < inputSetCount; inputSet++)
+      {
+        jobs.push_back({script, rSeed, inputSet});
+      }
+    }
+  }
+
+  std::vector<BatchResult> results(jobs.size());
+
+  size_t threadCount = config.threads;
+  if (threadCount == 0)
+  {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  threadCount = std::max<size_t>(std::min(threadCount, jobs.size()), 1);
+
+  // Deal jobs out in contiguous blocks
+  std::vector<WorkQueue> queues(threadCount);
+
+  for (size_t i = 0; i < jobs.size(); i++)
+  {
+    queues[i * threadCount / jobs.size()].push(i);
+  }
+
+  auto runJob = [&](size_t index)
+    {
+      const BatchJob& rJob = jobs[index];
+      BatchResult& rResult = results[index];
+
+      rResult.script = config.scripts[rJob.script].string();
+      rResult.seed = rJob.seed;
+      rResult.inputSet = rJob.inputSet;
+      rResult.wallMs = 0;
+
+      if (!scripts[rJob.script])
+      {
+        rResult.error = loadErrors[rJob.script];
+        return;
+      }
+
+      NetworkOptions options;
+      options.seed = rJob.seed;
+      options.writeFiles = config.writeFiles;
+
+      if (!config.inputSets.empty())
+      {
+        options.files = config.inputSets[rJob.inputSet];
+      }
+
+      if (!config.log)
+      {
+        options.pLog = nullptr;
+        options.pDump = nullptr;
+      }
+
+      auto start = std::chrono::steady_clock::now();
+
+      try
+      {
+        Network network(scripts[rJob.script], options);
+        rResult.stats = network.run(config.runOptions);
+      }
+      catch (const std::exception& e)
+      {
+        rResult.error = e.what();
+      }
+
+      auto stop = std::chrono::steady_clock::now();
+      rResult.wallMs = std::chrono::duration<double, std::milli>(stop - start).count();
+    };
+
+  auto worker = [&](size_t self)
+    {
+      while (true)
+      {
+        std::optional<size_t> job = queues[self].pop();
+
+        for (size_t i = 1; !job && i < threadCount; i++)
+        {
+          job = queues[(self + i) % threadCount].steal();
+        }
+
+        // No new jobs are ever queued, so empty queues everywhere means done
+        if (!job)
+        {
+          break;
+        }
+
+        runJob(*job);
+      }
+    };
+
+  std::vector<std::thread> threads;
+
+  for (size_t i = 1; i < threadCount; i++)
+  {
+    threads.emplace_back(worker, i);
+  }
+
+  worker(0);
+
+  for (auto& rThread : threads)
+  {
+    rThread.join();
+  }
+
+  return results;
+}
+
+void writeCsv(std::ostream& rStream, const std::vector<BatchResult>& results)
+{
+  rStream << "script,seed,input_set,size,cycles,activity,termination,wall_ms,"
+    "send_m_stalls,receive_m_stalls,link_full_stalls,node_full_stalls,error\n";
+
+  for (const auto& rResult : results)
+  {
+    rStream << csvField(rResult.script) << ',';
+
+    if (rResult.seed)
+    {
+      rStream << *rResult.seed;
+    }
+
+    rStream << ',' << rResult.inputSet
+      << ',' << rResult.stats.size
+      << ',' << rResult.stats.cycles
+      << ',' << rResult.stats.activity
+      << ',' << csvField(toString(rResult.stats.termination))
+      << ',' << rResult.wallMs;
+
+    for (uint64_t count : stallTotals(rResult.stats))
+    {
+      rStream << ',' << count;
+    }
+
+    rStream << ',' << csvField(rResult.error) << '\n';
+  }
+}
+
+void writeJson(std::ostream& rStream, const std::vector<BatchResult>& results)
+{
+  rStream << "[\n";
+
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const BatchResult& rResult = results[i];
+
+    rStream << "  {\"script\": " << jsonString(rResult.script) << ", \"seed\": ";
+
+    if (rResult.seed)
+    {
+      rStream << *rResult.seed;
+    }
+    else
+    {
+      rStream << "null";
+    }
+
+    rStream << ", \"inputSet\": " << rResult.inputSet
+      << ", \"size\": " << rResult.stats.size
+      << ", \"cycles\": " << rResult.stats.cycles
+      << ", \"activity\": " << rResult.stats.activity
+      << ", \"termination\": " << jsonString(toString(rResult.stats.termination))
+      << ", \"wallMs\": " << rResult.wallMs
+      << ", \"channels\": {";
+
+    for (size_t c = 0; c < rResult.stats.channels.size(); c++)
+    {
+      const auto& rChannel = rResult.stats.channels[c];
+
+      rStream << (c > 0 ? ", " : "") << jsonString(rChannel.first)
+        << ": {\"sends\": " << rChannel.second.sends
+        << ", \"receives\": " << rChannel.second.receives
+        << ", \"queued\": " << rChannel.second.queuedSends
+        << ", \"peakQueue\": " << rChannel.second.peakQueue
+        << ", \"sendStalls\": " << rChannel.second.sendStalls
+        << ", \"receiveStalls\": " << rChannel.second.receiveStalls << '}';
+    }
+
+    rStream << "}, \"stalls\": {";
+
+    StallCounts totals = stallTotals(rResult.stats);
+
+    for (size_t r = 0; r < totals.size(); r++)
+    {
+      rStream << (r > 0 ? ", " : "") << jsonString(toString(static_cast<StallReason>(r))) << ": " << totals[r];
+    }
+
+    rStream << "}, \"error\": ";
+
+    if (rResult.error.empty())
+    {
+      rStream << "null";
+    }
+    else
+    {
+      rStream << jsonString(rResult.error);
+    }
+
+    rStream << '}' << (i + 1 < results.size() ? "," : "") << '\n';
+  }
+
+  rStream << "]\n";
+}
+
+uint64_t parseCount(const std::string& text, uint64_t max)
+{
+  size_t end = 0;
+  uint64_t ret = 0;
+
+  // std::stoull would skip whitespace, accept a sign and wrap negatives around
+  if (!text.empty() && std::isdigit(static_cast<unsigned char>(text[0])))
+  {
+    ret = std::stoull(text, &end);
+  }
+
+  if (end == 0 || end != text.size() || ret > max)
+  {
+    throw Error("Expected a number from 0 to " + std::to_string(max) + ": " + text);
+  }
+
+  return ret;
+}
+
+double parseFraction(const std::string& text)
+{
+  size_t end = 0;
+  double ret = 0;
+
+  if (!text.empty() && std::isdigit(static_cast<unsigned char>(text[0])))
+  {
+    ret = std::stod(text, &end);
+  }
+
+  if (end == 0 || end != text.size() || !std::isfinite(ret))
+  {
+    throw Error("Expected a non-negative number: " + text);
+  }
+
+  return ret;
+}
+
+int batchMain(const std::vector<std::string>& args)
+{
+  static const char* pUsage =
+    "Usage: epp --batch [options] <script>...\n"
+    "  --seeds LIST      Comma separated seeds or ranges, e.g. 1,5,10-20\n"
+    "  --input ID=PATH,...  Add an input set replacing .file contents; repeatable\n"
+    "                    Every ID must name a .file in each script\n"
+    "  --threads N       Worker threads (default: one per hardware thread)\n"
+    "  --format csv|json Output format (default: csv)\n"
+    "  --output PATH     Write results to PATH instead of stdout\n"
+    "  --max-cycles N    Stop each run after N cycles\n"
+    "  --max-time MS     Stop each run after MS milliseconds\n"
+    "  --max-machines N  Stop a run once more than N machines are alive\n"
+    "  --max-memory B    Stop a run once it holds roughly more than B bytes\n"
+    "  --write-files     Write files back to disk after each run; not with --input\n"
+    "  --log             Show machine failures and DUMP output\n";
+
+  BatchConfig config;
+  std::string format = "csv";
+  std::optional<std::string> output;
+
+  try
+  {
+    for (size_t i = 0; i < args.size(); i++)
+    {
+      const std::string& rArg = args[i];
+      bool hasValue = i + 1 < args.size();
+
+      if (rArg == "--seeds" && hasValue)
+      {
+        parseSeeds(args[++i], config.seeds);
+      }
+      else if (rArg == "--input" && hasValue)
+      {
+        config.inputSets.push_back(parseInputSet(args[++i]));
+      }
+      else if (rArg == "--threads" && hasValue)
+      {
+        config.threads = parseCount(args[++i]);
+      }
+      else if (rArg == "--format" && hasValue)
+      {
+        format = args[++i];
+      }
+      else if (rArg == "--output" && hasValue)
+      {
+        output = args[++i];
+      }
+      else if (rArg == "--max-cycles" && hasValue)
+      {
+        config.runOptions.maxCycles = parseCount(args[++i]);
+      }
+      else if (rArg == "--max-time" && hasValue)
+      {
+        config.runOptions.maxTime = std::chrono::milliseconds(parseCount(args[++i], std::numeric_limits<std::chrono::milliseconds::rep>::max()));
+      }
+      else if (rArg == "--max-machines" && hasValue)
+      {
+        config.runOptions.maxMachines = parseCount(args[++i]);
+      }
+      else if (rArg == "--max-memory" && hasValue)
+      {
+        config.runOptions.maxMemory = parseCount(args[++i]);
+      }
+      else if (rArg == "--write-files")
+      {
+        config.writeFiles = true;
+      }
+      else if (rArg == "--log")
+      {
+        config.log = true;
+      }
+      else if (rArg.rfind("--", 0) == 0)
+      {
+        throw Error("Unrecognized or incomplete option: " + rArg);
+      }
+      else
+      {
+        config.scripts.emplace_back(rArg);
+      }
+    }
+
+    if (format != "csv" && format != "json")
+    {
+      throw Error("Unrecognized format: " + format);
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << '\n' << pUsage;
+    return 1;
+  }
+
+  if (config.scripts.empty())
+  {
+    std::cerr << pUsage;
+    return 1;
+  }
+
+  std::vector<BatchResult> results;
+
+  try
+  {
+    results = runBatch(config);
+  }
+  catch (const Error& e)
+  {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+
+  std::ofstream file;
+  if (output)
+  {
+    file.open(*output);
+
+    if (!file)
+    {
+      std::cerr << "Could not open " << *output << '\n';
+      return 1;
+    }
+  }
+
+  std::ostream& rOut = output ? file : std::cout;
+
+  if (format == "json")
+  {
+    writeJson(rOut, results);
+  }
+  else
+  {
+    writeCsv(rOut, results);
+  }
+
+  return 0;
+}
+} // namespace epp
@@ -0,0 +1,61 @@
+#ifndef EPP_BATCH_HPP
+#define EPP_BATCH_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "epp.hpp"
+
+namespace epp
+{
+using InputSet = std::map<uint16_t, std::filesystem::path>;
+
+struct BatchConfig
+{
+  std::vector<std::filesystem::path> scripts;
+  std::vector<uint64_t> seeds; // Empty runs each script once with its built-in seeds
+  std::vector<InputSet> inputSets; // Empty runs each script once with its own files
+  size_t threads = 0; // 0 uses one per hardware thread
+  bool writeFiles = false;
+  bool log = false; // Forward machine failures and DUMP output
+  RunOptions runOptions; // Limits for every run
+};
+
+struct BatchResult
+{
+  std::string script;
+  std::optional<uint64_t> seed;
+  size_t inputSet;
+  RunStats stats;
+  double wallMs;
+  std::string error; // Empty if the run completed
+};
+
+// Runs every combination of script, seed and input set. Each script is parsed
+// once and shared by all of its runs. Results are in combination order.
+// Throws Error before running anything if an input set names a file ID a
+// script does not declare, or if input sets are combined with writeFiles.
+std::vector<BatchResult> runBatch(const BatchConfig& config);
+
+void writeCsv(std::ostream& rStream, const std::vector<BatchResult>& results);
+
+void writeJson(std::ostream& rStream, const std::vector<BatchResult>& results);
+
+// Parses a whole decimal option value in [0, max] and throws Error otherwise.
+// Unlike std::stoul it rejects a sign, so -1 is an error, not a huge count.
+uint64_t parseCount(const std::string& text, uint64_t max = std::numeric_limits<uint64_t>::max());
+
+// The same for a non-negative decimal such as 0.15
+double parseFraction(const std::string& text);
+
+// Entry point for `epp --batch`; takes the arguments after --batch
+int batchMain(const std::vector<std::string>& args);
+} // namespace epp
+
+#endif // EPP_BATCH_HPP
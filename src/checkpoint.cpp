@@ -0,0 +1,685 @@
+#include <cstring>
+#include <sstream>
+#include <type_traits>
+#include <unordered_map>
+
+#include "epp.hpp"
+
+namespace epp
+{
+namespace
+{
+constexpr char checkpointMagic[8] = {'E', 'P', 'P', 'C', 'K', 'P', 'T', '2'};
+
+// What follows each hardware register in a checkpoint
+enum class RegisterState : uint8_t
+{
+  None,
+  Rand, // Engine state string
+  FileIn // int64 read position, -1 at end of file
+};
+
+// Native-endian, so checkpoints are only portable between like machines
+class Writer
+{
+public:
+  template <typename T>
+  void pod(const T& value)
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const char* pBytes = reinterpret_cast<const char*>(&value);
+    buffer.append(pBytes, sizeof(T));
+  }
+
+  void string(const std::string& str)
+  {
+    pod<uint64_t>(str.size());
+    buffer.append(str);
+  }
+
+  void value(const Value& val)
+  {
+    if (val.isNumber())
+    {
+      pod<uint8_t>(0);
+      pod(val.number());
+    }
+    else
+    {
+      pod<uint8_t>(1);
+      string(val.string());
+    }
+  }
+
+  template <typename T>
+  void podVector(const std::vector<T>& values)
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    pod<uint64_t>(values.size());
+    buffer.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+  }
+
+  void values(const std::vector<Value>& vals)
+  {
+    pod<uint64_t>(vals.size());
+
+    for (const auto& rVal : vals)
+    {
+      value(rVal);
+    }
+  }
+
+  void file(const File& f)
+  {
+    string(f.filename.string());
+    values(f.values);
+    pod(f.id);
+    pod(f.locked);
+    pod(f.readonly);
+    pod<uint64_t>(f.offset);
+  }
+
+  void channel(const Channel& rChannel)
+  {
+    values(rChannel.buffer);
+    pod<uint64_t>(rChannel.head);
+    pod<uint64_t>(rChannel.count);
+    pod<uint64_t>(rChannel.depth);
+    pod<uint64_t>(rChannel.waiting.size());
+
+    for (const auto& rSender : rChannel.waiting)
+    {
+      pod(rSender.machine);
+      value(rSender.value);
+    }
+
+    pod(rChannel.stats);
+  }
+
+  std::string buffer;
+};
+
+class Reader
+{
+public:
+  Reader(const std::string& data, size_t offset)
+    : buffer(data),
+    offset(offset)
+  {
+    // Empty
+  }
+
+  template <typename T>
+  T pod()
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T ret{};
+    std::memcpy(&ret, take(sizeof(T)), sizeof(T));
+    return ret;
+  }
+
+  std::string string()
+  {
+    size_t size = pod<uint64_t>();
+    return std::string(take(size), size);
+  }
+
+  Value value()
+  {
+    if (pod<uint8_t>() == 0)
+    {
+      return pod<Number>();
+    }
+
+    return string();
+  }
+
+  template <typename T>
+  void podVector(std::vector<T>& rValues)
+  {
+    size_t size = pod<uint64_t>();
+    const char* pBytes = take(size * sizeof(T));
+    rValues.resize(size);
+
+    if (size > 0)
+    {
+      std::memcpy(rValues.data(), pBytes, size * sizeof(T));
+    }
+  }
+
+  std::vector<Value> values()
+  {
+    std::vector<Value> ret(pod<uint64_t>());
+
+    for (auto& rVal : ret)
+    {
+      rVal = value();
+    }
+
+    return ret;
+  }
+
+  File file()
+  {
+    File ret;
+    ret.filename = string();
+    ret.values = values();
+    ret.id = pod<uint16_t>();
+    ret.locked = pod<bool>();
+    ret.readonly = pod<bool>();
+    ret.offset = pod<uint64_t>();
+
+    if (ret.offset > ret.values.size())
+    {
+      throw Error("Checkpoint has a corrupt file");
+    }
+
+    return ret;
+  }
+
+  void channel(Channel& rChannel)
+  {
+    rChannel.buffer = values();
+    rChannel.head = pod<uint64_t>();
+    rChannel.count = pod<uint64_t>();
+    rChannel.depth = pod<uint64_t>();
+    rChannel.waiting.resize(pod<uint64_t>());
+
+    for (auto& rSender : rChannel.waiting)
+    {
+      rSender.machine = pod<MachineId>();
+      rSender.value = value();
+    }
+
+    rChannel.stats = pod<ChannelStats>();
+
+    // The ring is allocated on first send, so it is either empty or full size
+    if (rChannel.depth == 0 || rChannel.head >= rChannel.depth || rChannel.count > rChannel.depth ||
+      (!rChannel.buffer.empty() && rChannel.buffer.size() != rChannel.depth) ||
+      (rChannel.buffer.empty() && (rChannel.count > 0 || rChannel.head > 0)))
+    {
+      throw Error("Checkpoint has a corrupt channel");
+    }
+  }
+
+  bool done() const
+  {
+    return offset == buffer.size();
+  }
+
+private:
+  const char* take(size_t size)
+  {
+    if (size > buffer.size() - offset)
+    {
+      throw Error("Checkpoint is truncated");
+    }
+
+    const char* pRet = buffer.data() + offset;
+    offset += size;
+    return pRet;
+  }
+
+  const std::string& buffer;
+  size_t offset;
+};
+
+template <typename Engine>
+std::string engineState(const Engine& engine)
+{
+  std::ostringstream stream;
+  stream << engine;
+  return stream.str();
+}
+
+template <typename Engine>
+void restoreEngine(Engine& rEngine, const std::string& state)
+{
+  std::istringstream stream(state);
+  stream >> rEngine;
+
+  if (!stream)
+  {
+    throw Error("Checkpoint has a corrupt RNG state");
+  }
+}
+} // namespace
+
+void Network::saveCheckpoint(const std::filesystem::path& path) const
+{
+  const Script& rScript = *pScript;
+
+  std::unordered_map<const Program*, uint32_t> programIndex;
+  for (size_t i = 0; i < rScript.programs.size(); i++)
+  {
+    programIndex.emplace(rScript.programs[i].get(), static_cast<uint32_t>(i));
+  }
+
+  std::unordered_map<const Channel*, uint32_t> channelIndex;
+  for (size_t i = 0; i < globalChannels.size(); i++)
+  {
+    channelIndex.emplace(&globalChannels[i], static_cast<uint32_t>(i + 1));
+  }
+
+  for (size_t i = 0; i < nodes.size(); i++)
+  {
+    channelIndex.emplace(&nodes[i].localChannel, static_cast<uint32_t>(globalChannels.size() + i + 1));
+  }
+
+  Writer out;
+  out.buffer.append(checkpointMagic, sizeof(checkpointMagic));
+
+  // Enough of the script's shape to catch restoring into the wrong one
+  out.pod<uint64_t>(nodes.size());
+  out.pod<uint64_t>(rScript.programs.size());
+  out.pod<uint64_t>(globalChannels.size());
+  out.pod<uint64_t>(rScript.size);
+
+  out.pod(nextFileId);
+  out.string(engineState(random));
+  out.pod<uint64_t>(stats.cycles);
+  out.pod<uint64_t>(stats.activity);
+
+  for (const auto& rChannel : globalChannels)
+  {
+    out.channel(rChannel);
+  }
+
+  out.pod<uint64_t>(machinePool.records.size());
+
+  for (const auto& rInfo : machinePool.records)
+  {
+    out.pod<uint8_t>(rInfo.file.has_value());
+    if (rInfo.file)
+    {
+      out.file(*rInfo.file);
+    }
+
+    auto programIter = programIndex.find(rInfo.pProgram);
+    out.pod<uint32_t>(programIter == programIndex.end() ? std::numeric_limits<uint32_t>::max() : programIter->second);
+    out.pod<uint32_t>(rInfo.pSendChannel ? channelIndex.at(rInfo.pSendChannel) : 0);
+    out.pod(rInfo.parent);
+    out.pod(rInfo.replIndex);
+    out.pod(rInfo.replCount);
+    out.pod(rInfo.refs);
+  }
+
+  out.podVector(machinePool.freeList);
+  out.pod<uint64_t>(machinePool.liveCount);
+
+  for (const auto& rNode : nodes)
+  {
+    const MachineTable& rMachines = rNode.machines;
+
+    std::vector<uint32_t> programs;
+    for (const Program* pProgram : rMachines.program)
+    {
+      programs.push_back(programIndex.at(pProgram));
+    }
+
+    out.pod<uint64_t>(rNode.occupancy);
+    out.podVector(rMachines.instPtr);
+    out.podVector(programs);
+    out.values(rMachines.x);
+    out.values(rMachines.t);
+    out.podVector(rMachines.sendingM);
+    out.podVector(rMachines.globalMode);
+    out.podVector(rMachines.channel);
+    out.podVector(rMachines.terminated);
+    out.podVector(rMachines.id);
+
+    out.pod<uint64_t>(rNode.files.size());
+
+    for (const auto& rPair : rNode.files)
+    {
+      out.file(rPair.second);
+    }
+
+    out.channel(rNode.localChannel);
+    out.pod(rNode.stalls);
+  }
+
+  out.podVector(programStalls);
+
+  // Registers replaced by a replay hold no state, so each entry says what follows
+  for (HwRegister* pRegister : hwRegisters)
+  {
+    if (auto pRecording = dynamic_cast<RecordingRegister*>(pRegister))
+    {
+      pRegister = pRecording->pInner.get();
+    }
+
+    if (auto pRand = dynamic_cast<RandRegister*>(pRegister))
+    {
+      out.pod(RegisterState::Rand);
+      out.string(engineState(pRand->gen));
+    }
+    else if (auto pFileIn = dynamic_cast<FileInRegister*>(pRegister))
+    {
+      out.pod(RegisterState::FileIn);
+      out.pod<int64_t>(pFileIn->stream ? static_cast<int64_t>(pFileIn->stream.tellg()) : -1);
+    }
+    else
+    {
+      out.pod(RegisterState::None);
+    }
+  }
+
+  // Recording and replaying the same log reach the same offset at the same cycle
+  uint64_t inputLogPosition = 0;
+
+  if (pRecorder)
+  {
+    inputLogPosition = pRecorder->position();
+  }
+  else if (pReplayer)
+  {
+    inputLogPosition = pReplayer->position();
+  }
+
+  out.pod(inputLogPosition);
+
+  // Write to the side and rename, so a crash mid-write keeps the last checkpoint
+  std::filesystem::path tempPath = path;
+  tempPath += ".tmp";
+
+  {
+    std::ofstream stream(tempPath, std::ios::binary | std::ios::trunc);
+    stream.write(out.buffer.data(), out.buffer.size());
+
+    if (!stream)
+    {
+      throw Error("Could not write checkpoint: " + tempPath.string());
+    }
+  }
+
+  std::filesystem::rename(tempPath, path);
+}
+
+void Network::loadCheckpoint(const std::filesystem::path& path)
+{
+  const Script& rScript = *pScript;
+
+  if (pRecorder)
+  {
+    throw Error("Cannot record a resumed run; the input log would miss everything before the checkpoint");
+  }
+
+  std::ifstream stream(path, std::ios::binary);
+  if (!stream)
+  {
+    throw Error("Could not open checkpoint: " + path.string());
+  }
+
+  std::string data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+  if (data.size() < sizeof(checkpointMagic) || std::memcmp(data.data(), checkpointMagic, sizeof(checkpointMagic)) != 0)
+  {
+    throw Error("Not a checkpoint: " + path.string());
+  }
+
+  Reader in(data, sizeof(checkpointMagic));
+
+  if (in.pod<uint64_t>() != nodes.size() ||
+    in.pod<uint64_t>() != rScript.programs.size() ||
+    in.pod<uint64_t>() != globalChannels.size() ||
+    in.pod<uint64_t>() != rScript.size)
+  {
+    throw Error("Checkpoint was taken from a different script");
+  }
+
+  nextFileId = in.pod<uint16_t>();
+  restoreEngine(random, in.string());
+  stats.cycles = in.pod<uint64_t>();
+  stats.activity = in.pod<uint64_t>();
+
+  for (auto& rChannel : globalChannels)
+  {
+    in.channel(rChannel);
+  }
+
+  auto program = [&](uint32_t index) -> const Program*
+    {
+      if (index == std::numeric_limits<uint32_t>::max())
+      {
+        return nullptr;
+      }
+
+      if (index >= rScript.programs.size())
+      {
+        throw Error("Checkpoint refers to an unknown program");
+      }
+
+      return rScript.programs[index].get();
+    };
+
+  machinePool.records.resize(in.pod<uint64_t>());
+
+  for (auto& rInfo : machinePool.records)
+  {
+    rInfo.file.reset();
+    if (in.pod<uint8_t>())
+    {
+      rInfo.file = in.file();
+    }
+
+    rInfo.pProgram = program(in.pod<uint32_t>());
+
+    uint32_t channel = in.pod<uint32_t>();
+
+    if (channel == 0)
+    {
+      rInfo.pSendChannel = nullptr;
+    }
+    else if (channel <= globalChannels.size())
+    {
+      rInfo.pSendChannel = &globalChannels[channel - 1];
+    }
+    else if (channel - globalChannels.size() <= nodes.size())
+    {
+      rInfo.pSendChannel = &nodes[channel - globalChannels.size() - 1].localChannel;
+    }
+    else
+    {
+      throw Error("Checkpoint refers to an unknown channel");
+    }
+
+    rInfo.parent = in.pod<MachineId>();
+    rInfo.replIndex = in.pod<uint32_t>();
+    rInfo.replCount = in.pod<uint32_t>();
+    rInfo.refs = in.pod<uint32_t>();
+  }
+
+  auto checkMachine = [&](MachineId id)
+    {
+      if (id >= machinePool.records.size())
+      {
+        throw Error("Checkpoint refers to an unknown machine");
+      }
+    };
+
+  for (const auto& rInfo : machinePool.records)
+  {
+    if (rInfo.parent != MachinePool::noParent)
+    {
+      checkMachine(rInfo.parent);
+    }
+  }
+
+  in.podVector(machinePool.freeList);
+  machinePool.liveCount = in.pod<uint64_t>();
+
+  for (MachineId id : machinePool.freeList)
+  {
+    checkMachine(id);
+  }
+
+  for (auto& rNode : nodes)
+  {
+    MachineTable& rMachines = rNode.machines;
+
+    std::vector<uint32_t> programs;
+
+    rNode.occupancy = in.pod<uint64_t>();
+    in.podVector(rMachines.instPtr);
+    in.podVector(programs);
+    rMachines.x = in.values();
+    rMachines.t = in.values();
+    in.podVector(rMachines.sendingM);
+    in.podVector(rMachines.globalMode);
+    in.podVector(rMachines.channel);
+    in.podVector(rMachines.terminated);
+    in.podVector(rMachines.id);
+
+    size_t count = rMachines.instPtr.size();
+
+    if (programs.size() != count || rMachines.x.size() != count || rMachines.t.size() != count ||
+      rMachines.sendingM.size() != count || rMachines.globalMode.size() != count ||
+      rMachines.channel.size() != count || rMachines.terminated.size() != count || rMachines.id.size() != count)
+    {
+      throw Error("Checkpoint has a corrupt machine table");
+    }
+
+    rMachines.program.clear();
+
+    for (uint32_t index : programs)
+    {
+      const Program* pProgram = program(index);
+
+      if (!pProgram)
+      {
+        throw Error("Checkpoint refers to an unknown program");
+      }
+
+      rMachines.program.push_back(pProgram);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+      checkMachine(rMachines.id[i]);
+
+      if (rMachines.channel[i] >= globalChannels.size())
+      {
+        throw Error("Checkpoint refers to an unknown channel");
+      }
+
+      if (rMachines.sendingM[i] && !machinePool.records[rMachines.id[i]].pSendChannel)
+      {
+        throw Error("Checkpoint has a sending machine outside any channel queue");
+      }
+    }
+
+    rNode.files.clear();
+
+    for (size_t count = in.pod<uint64_t>(); count > 0; count--)
+    {
+      File file = in.file();
+      uint16_t id = file.id;
+      rNode.files.emplace(id, std::move(file));
+    }
+
+    in.channel(rNode.localChannel);
+    rNode.stalls = in.pod<StallCounts>();
+  }
+
+  in.podVector(programStalls);
+
+  if (programStalls.size() != rScript.programs.size())
+  {
+    throw Error("Checkpoint was taken from a different script");
+  }
+
+  // Each queued sender must be known, and be queued exactly where its record says
+  std::vector<uint8_t> queued(machinePool.records.size());
+
+  auto checkQueue = [&](const Channel& rChannel)
+    {
+      for (const auto& rSender : rChannel.waiting)
+      {
+        checkMachine(rSender.machine);
+
+        if (machinePool.records[rSender.machine].pSendChannel != &rChannel || queued[rSender.machine])
+        {
+          throw Error("Checkpoint has a corrupt channel queue");
+        }
+
+        queued[rSender.machine] = true;
+      }
+    };
+
+  for (const auto& rChannel : globalChannels)
+  {
+    checkQueue(rChannel);
+  }
+
+  for (const auto& rNode : nodes)
+  {
+    checkQueue(rNode.localChannel);
+  }
+
+  for (size_t id = 0; id < machinePool.records.size(); id++)
+  {
+    if (machinePool.records[id].pSendChannel && !queued[id])
+    {
+      throw Error("Checkpoint has a corrupt channel queue");
+    }
+  }
+
+  for (HwRegister* pRegister : hwRegisters)
+  {
+    if (auto pRecording = dynamic_cast<RecordingRegister*>(pRegister))
+    {
+      pRegister = pRecording->pInner.get();
+    }
+
+    auto state = in.pod<RegisterState>();
+
+    if (state == RegisterState::Rand)
+    {
+      std::string engine = in.string();
+
+      if (auto pRand = dynamic_cast<RandRegister*>(pRegister))
+      {
+        restoreEngine(pRand->gen, engine);
+      }
+    }
+    else if (state == RegisterState::FileIn)
+    {
+      int64_t position = in.pod<int64_t>();
+
+      if (auto pFileIn = dynamic_cast<FileInRegister*>(pRegister))
+      {
+        if (position < 0)
+        {
+          pFileIn->stream.setstate(std::ios::eofbit | std::ios::failbit);
+        }
+        else
+        {
+          pFileIn->stream.seekg(position);
+        }
+      }
+    }
+    else if (state != RegisterState::None)
+    {
+      throw Error("Checkpoint has a corrupt register state");
+    }
+  }
+
+  uint64_t inputLogPosition = in.pod<uint64_t>();
+
+  if (pReplayer)
+  {
+    if (inputLogPosition == 0)
+    {
+      throw Error("Checkpoint was taken from a run that neither recorded nor replayed inputs");
+    }
+
+    pReplayer->seek(inputLogPosition);
+  }
+
+  if (!in.done())
+  {
+    throw Error("Checkpoint has trailing data");
+  }
+}
+} // namespace epp
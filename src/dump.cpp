@@ -0,0 +1,222 @@
+#include <sstream>
+
+#include "dump.hpp"
+#include "epp.hpp"
+
+namespace epp
+{
+namespace
+{
+void writeValue(DumpWriter& rWriter, const Value& val)
+{
+  if (val.isNumber())
+  {
+    rWriter.pod<uint8_t>(0);
+    rWriter.pod(val.number());
+  }
+  else
+  {
+    rWriter.pod<uint8_t>(1);
+    rWriter.string(val.string());
+  }
+}
+
+void writeFile(DumpWriter& rWriter, const File& file)
+{
+  rWriter.pod(file.id);
+  rWriter.string(file.filename.string());
+  rWriter.pod<uint8_t>(file.locked);
+  rWriter.pod<uint8_t>(file.readonly);
+  rWriter.pod<uint64_t>(file.offset);
+  rWriter.pod(static_cast<uint32_t>(file.values.size()));
+
+  for (const auto& rVal : file.values)
+  {
+    writeValue(rWriter, rVal);
+  }
+}
+
+void writeChannel(DumpWriter& rWriter, const Channel& channel)
+{
+  rWriter.pod(static_cast<uint32_t>(channel.count));
+
+  for (size_t i = 0; i < channel.count; i++)
+  {
+    writeValue(rWriter, channel.buffer[(channel.head + i) % channel.depth]);
+  }
+
+  rWriter.pod(static_cast<uint32_t>(channel.waiting.size()));
+}
+
+// Everything but the name
+void writeMachineState(DumpWriter& rWriter, const MachineTable& machines, size_t index, const MachinePool& pool)
+{
+  const MachineInfo& rInfo = pool[machines.id[index]];
+
+  rWriter.pod(static_cast<uint32_t>(machines.program[index]->index));
+  rWriter.pod(static_cast<uint32_t>(machines.instPtr[index]));
+  writeValue(rWriter, machines.x[index]);
+  writeValue(rWriter, machines.t[index]);
+  rWriter.pod<uint8_t>(rInfo.file.has_value());
+
+  if (rInfo.file)
+  {
+    writeFile(rWriter, *rInfo.file);
+  }
+}
+
+void writeMachine(DumpWriter& rWriter, const MachineTable& machines, size_t index, const MachinePool& pool)
+{
+  rWriter.string(pool.name(machines.id[index]));
+  writeMachineState(rWriter, machines, index, pool);
+}
+} // namespace
+
+DumpWriter::DumpWriter(const std::filesystem::path& path)
+  : path(path),
+  buffer(),
+  stream(path, std::ios::binary | std::ios::trunc)
+{
+  if (!stream)
+  {
+    throw Error("Could not open dump file: " + path.string());
+  }
+
+  buffer.reserve(flushSize);
+  buffer.append(dumpMagic, sizeof(dumpMagic));
+}
+
+DumpWriter::~DumpWriter()
+{
+  stream.write(buffer.data(), buffer.size());
+}
+
+void DumpWriter::string(const std::string& str)
+{
+  pod(static_cast<uint32_t>(str.size()));
+  buffer.append(str);
+}
+
+void DumpWriter::commit()
+{
+  if (buffer.size() >= flushSize)
+  {
+    flush();
+  }
+}
+
+void DumpWriter::flush()
+{
+  stream.write(buffer.data(), buffer.size());
+  stream.flush();
+  buffer.clear();
+
+  if (!stream.good())
+  {
+    throw Error("Could not write dump file: " + path.string());
+  }
+}
+
+void Network::openDump(const std::filesystem::path& path)
+{
+  pDumpWriter = std::make_unique<DumpWriter>(path);
+  DumpWriter& rWriter = *pDumpWriter;
+
+  // Code is formatted once here rather than on every DUMP code
+  rWriter.pod(static_cast<uint32_t>(pScript->programs.size()));
+  for (const auto& rpProgram : pScript->programs)
+  {
+    rWriter.string(rpProgram->name);
+    rWriter.pod(static_cast<uint32_t>(rpProgram->code.size()));
+
+    for (const auto& rInst : rpProgram->code)
+    {
+      std::ostringstream text;
+      text << rInst;
+      rWriter.string(text.str());
+    }
+  }
+
+  rWriter.pod(static_cast<uint32_t>(nodes.size()));
+  for (const auto& rNode : nodes)
+  {
+    rWriter.string(rNode.name);
+  }
+
+  rWriter.pod(static_cast<uint32_t>(pScript->channels.size()));
+  for (const auto& rSpec : pScript->channels)
+  {
+    rWriter.pod(static_cast<int64_t>(rSpec.id));
+  }
+
+  rWriter.commit();
+}
+
+void Network::writeDump(DumpRecord type, const Node& rNode, size_t machine)
+{
+  DumpWriter& rWriter = *pDumpWriter;
+  const MachineTable& rMachines = rNode.machines;
+
+  rWriter.pod(type);
+  rWriter.pod<uint64_t>(stats.cycles);
+  rWriter.pod(static_cast<uint32_t>(&rNode - nodes.data()));
+  rWriter.string(machinePool.name(rMachines.id[machine]));
+
+  switch (type)
+  {
+    case DumpRecord::Machine:
+      writeMachineState(rWriter, rMachines, machine, machinePool);
+      break;
+    case DumpRecord::Code:
+      rWriter.pod(static_cast<uint32_t>(rMachines.program[machine]->index));
+      break;
+    case DumpRecord::Network:
+      rWriter.pod(static_cast<uint32_t>(nodes.size()));
+
+      for (const auto& rEach : nodes)
+      {
+        // The pass over rNode has compacted the slots before machine, leaving
+        // a gap of dropped rows just below it
+        size_t gapEnd = &rEach == &rNode ? machine : 0;
+        size_t gapBegin = gapEnd - (&rEach == &rNode ? retiredSlots.size() : 0);
+
+        rWriter.pod(static_cast<uint32_t>(rEach.machines.size() - (gapEnd - gapBegin) + rEach.incomingMachines.size()));
+
+        for (size_t i = 0; i < rEach.machines.size(); i++)
+        {
+          if (i == gapBegin)
+          {
+            i = gapEnd;
+          }
+
+          writeMachine(rWriter, rEach.machines, i, machinePool);
+        }
+
+        for (size_t i = 0; i < rEach.incomingMachines.size(); i++)
+        {
+          writeMachine(rWriter, rEach.incomingMachines, i, machinePool);
+        }
+
+        rWriter.pod(static_cast<uint32_t>(rEach.files.size()));
+
+        for (const auto& rPair : rEach.files)
+        {
+          writeFile(rWriter, rPair.second);
+        }
+
+        writeChannel(rWriter, rEach.localChannel);
+      }
+
+      rWriter.pod(static_cast<uint32_t>(globalChannels.size()));
+
+      for (const auto& rChannel : globalChannels)
+      {
+        writeChannel(rWriter, rChannel);
+      }
+
+      break;
+  }
+
+  rWriter.commit();
+}
+} // namespace epp
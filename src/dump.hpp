@@ -0,0 +1,82 @@
+#ifndef EPP_DUMP_HPP
+#define EPP_DUMP_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Binary DUMP output. The file starts with a header naming programs (with
+// their code already formatted), nodes and global channels, followed by one
+// record per DUMP instruction. Everything is native-endian.
+//
+// Header: magic, then u32 program count and per program its name and a u32
+// count of instruction strings, then u32 node count and node names, then u32
+// global channel count and their i64 IDs.
+//
+// Record: u8 DumpRecord, u64 cycle, u32 node, the dumping machine's name, then
+// a body by type:
+//   Machine: the machine, less the name the record already gave
+//   Code: u32 program index
+//   Network: u32 node count; per node its machines, files and local channel,
+//     then u32 global channel count and the channels
+//
+// A channel is its values oldest first, then u32 queued senders.
+//
+//
+// A machine is its name, u32 program index, u32 instPtr, x, t, u8 has-file and
+// the file if it has one. A file is u16 ID, path, u8 locked, u8 readonly, u64
+// offset, and its values. Lists of machines, files and values start with a u32
+// count. Values are u8 0 and an i64, or u8 1 and a string. Strings are a u32
+// length and the bytes.
+namespace epp
+{
+constexpr char dumpMagic[8] = {'E', 'P', 'P', 'D', 'U', 'M', 'P', '3'};
+
+enum class DumpRecord : uint8_t
+{
+  Network, // DUMP
+  Machine, // DUMP me
+  Code // DUMP code
+};
+
+// Appends records to an in-memory buffer and writes each one out whole, so a
+// DUMP costs a copy into the buffer rather than formatting and terminal I/O.
+// Write failures throw Error, except from the destructor.
+class DumpWriter
+{
+public:
+  explicit DumpWriter(const std::filesystem::path& path);
+
+  ~DumpWriter();
+
+  DumpWriter(const DumpWriter&) = delete;
+  DumpWriter& operator=(const DumpWriter&) = delete;
+
+  template <typename T>
+  void pod(const T& value)
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  void string(const std::string& str);
+
+  // Hands the buffered bytes to the stream once enough have built up
+  void commit();
+
+  // Hands over whatever is buffered, as at the end of a run
+  void flush();
+
+private:
+  static constexpr size_t flushSize = 1 << 20;
+
+  std::filesystem::path path;
+  std::string buffer;
+  std::ofstream stream;
+};
+} // namespace epp
+
+#endif // EPP_DUMP_HPP
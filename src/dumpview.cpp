@@ -0,0 +1,276 @@
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "dump.hpp"
+
+// Renders a binary DUMP file written by `epp --dump-file` in the same form as
+// text DUMP output, with each record prefixed by where and when it was taken
+namespace
+{
+class Reader
+{
+public:
+  explicit Reader(std::istream& rStream)
+    : stream(rStream)
+  {
+    // Empty
+  }
+
+  bool atEnd()
+  {
+    return stream.peek() == std::char_traits<char>::eof();
+  }
+
+  template <typename T>
+  T pod()
+  {
+    T ret{};
+    if (!stream.read(reinterpret_cast<char*>(&ret), sizeof(ret)))
+    {
+      throw std::runtime_error("Dump is truncated");
+    }
+
+    return ret;
+  }
+
+  std::string string()
+  {
+    std::string ret(pod<uint32_t>(), '\0');
+    if (!stream.read(ret.data(), ret.size()))
+    {
+      throw std::runtime_error("Dump is truncated");
+    }
+
+    return ret;
+  }
+
+  std::string value()
+  {
+    if (pod<uint8_t>() == 0)
+    {
+      return std::to_string(pod<int64_t>());
+    }
+
+    return string();
+  }
+
+private:
+  std::istream& stream;
+};
+
+struct Header
+{
+  std::vector<std::string> programNames;
+  std::vector<std::vector<std::string>> code;
+  std::vector<std::string> nodeNames;
+  std::vector<int64_t> channelIds;
+};
+
+void renderFile(Reader& rReader, std::ostream& rOut)
+{
+  uint16_t id = rReader.pod<uint16_t>();
+  std::string filename = rReader.string();
+  bool locked = rReader.pod<uint8_t>();
+  bool readonly = rReader.pod<uint8_t>();
+  uint64_t offset = rReader.pod<uint64_t>();
+
+  rOut << "File{filename=" << std::quoted(filename) << "; id=" << id << "; locked=" << locked << "; readonly=" << readonly << "; offset=" << offset;
+  rOut << "; content={";
+
+  for (uint32_t count = rReader.pod<uint32_t>(); count > 0; count--)
+  {
+    rOut << rReader.value() << "; ";
+  }
+
+  rOut << "}}";
+}
+
+void renderMachine(Reader& rReader, std::ostream& rOut, const std::string& name)
+{
+  rReader.pod<uint32_t>(); // Program
+  uint32_t instPtr = rReader.pod<uint32_t>();
+  std::string x = rReader.value();
+  std::string t = rReader.value();
+
+  rOut << "Machine{name=" << name << "; x=" << x << "; t=" << t << "; file=";
+
+  if (rReader.pod<uint8_t>())
+  {
+    rOut << '{';
+    renderFile(rReader, rOut);
+    rOut << '}';
+  }
+  else
+  {
+    rOut << "<none>";
+  }
+
+  rOut << "; instPtr=" << instPtr << '}';
+}
+
+void renderChannel(Reader& rReader, std::ostream& rOut)
+{
+  rOut << '{';
+
+  for (uint32_t count = rReader.pod<uint32_t>(); count > 0; count--)
+  {
+    rOut << rReader.value() << "; ";
+  }
+
+  rOut << "} queued=" << rReader.pod<uint32_t>() << '\n';
+}
+
+void renderNetwork(Reader& rReader, std::ostream& rOut, const Header& header)
+{
+  uint32_t nodeCount = rReader.pod<uint32_t>();
+
+  for (uint32_t node = 0; node < nodeCount; node++)
+  {
+    rOut << "Node " << (node < header.nodeNames.size() ? header.nodeNames[node] : "?") << '\n';
+
+    for (uint32_t count = rReader.pod<uint32_t>(); count > 0; count--)
+    {
+      rOut << "  ";
+      std::string name = rReader.string();
+      renderMachine(rReader, rOut, name);
+      rOut << '\n';
+    }
+
+    for (uint32_t count = rReader.pod<uint32_t>(); count > 0; count--)
+    {
+      rOut << "  ";
+      renderFile(rReader, rOut);
+      rOut << '\n';
+    }
+
+    rOut << "  Local channel: ";
+    renderChannel(rReader, rOut);
+  }
+
+  uint32_t channelCount = rReader.pod<uint32_t>();
+
+  for (uint32_t channel = 0; channel < channelCount; channel++)
+  {
+    rOut << "Channel " << (channel < header.channelIds.size() ? std::to_string(header.channelIds[channel]) : "?") << ": ";
+    renderChannel(rReader, rOut);
+  }
+}
+
+Header readHeader(Reader& rReader)
+{
+  char magic[sizeof(epp::dumpMagic)];
+  for (char& rChar : magic)
+  {
+    rChar = rReader.pod<char>();
+  }
+
+  if (std::memcmp(magic, epp::dumpMagic, sizeof(magic)) != 0)
+  {
+    throw std::runtime_error("Not a dump file");
+  }
+
+  Header ret;
+
+  ret.programNames.resize(rReader.pod<uint32_t>());
+  ret.code.resize(ret.programNames.size());
+  for (size_t i = 0; i < ret.programNames.size(); i++)
+  {
+    ret.programNames[i] = rReader.string();
+    ret.code[i].resize(rReader.pod<uint32_t>());
+
+    for (auto& rInst : ret.code[i])
+    {
+      rInst = rReader.string();
+    }
+  }
+
+  ret.nodeNames.resize(rReader.pod<uint32_t>());
+  for (auto& rName : ret.nodeNames)
+  {
+    rName = rReader.string();
+  }
+
+  ret.channelIds.resize(rReader.pod<uint32_t>());
+  for (auto& rId : ret.channelIds)
+  {
+    rId = rReader.pod<int64_t>();
+  }
+
+  return ret;
+}
+} // namespace
+
+int main(int argc, char** pArgv)
+{
+  if (argc != 2)
+  {
+    std::cout << "Usage: " << pArgv[0] << " <dump>" << '\n';
+    return 1;
+  }
+
+  std::ifstream in(pArgv[1], std::ios::binary);
+  if (!in)
+  {
+    std::cerr << "Could not open dump file: " << pArgv[1] << '\n';
+    return 1;
+  }
+
+  try
+  {
+    Reader reader(in);
+    Header header = readHeader(reader);
+
+    while (!reader.atEnd())
+    {
+      auto type = static_cast<epp::DumpRecord>(reader.pod<uint8_t>());
+      uint64_t cycle = reader.pod<uint64_t>();
+      uint32_t node = reader.pod<uint32_t>();
+      std::string machine = reader.string();
+
+      std::cout << "[cycle " << cycle << ", " << (node < header.nodeNames.size() ? header.nodeNames[node] : "?") << ", " << machine << "]\n";
+
+      switch (type)
+      {
+        case epp::DumpRecord::Machine:
+          renderMachine(reader, std::cout, machine);
+          std::cout << '\n';
+          break;
+        case epp::DumpRecord::Code:
+        {
+          uint32_t program = reader.pod<uint32_t>();
+          std::cout << "Code:[";
+
+          if (program < header.code.size())
+          {
+            const auto& rCode = header.code[program];
+
+            for (size_t i = 0; i < rCode.size(); i++)
+            {
+              std::cout << rCode[i] << (i < rCode.size() - 1 ? "; " : "");
+            }
+          }
+
+          std::cout << "]\n";
+          break;
+        }
+        case epp::DumpRecord::Network:
+          renderNetwork(reader, std::cout, header);
+          break;
+        default:
+          throw std::runtime_error("Unknown dump record");
+      }
+    }
+  }
+  catch (const std::exception& exc)
+  {
+    std::cerr << exc.what() << '\n';
+    return 1;
+  }
+
+  return 0;
+}
@@ -1,10 +1,12 @@
 #include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 #include <limits>
 #include <regex>
 #include <sstream>
+#include <unordered_set>
 
 #include "epp.hpp"
 
@@ -16,21 +18,188 @@
 
 namespace epp
 {
+struct Value::Text
+{
+  std::atomic<uint32_t> refs;
+  std::string text;
+};
+
+Value::Value(std::string string)
+  : word(reinterpret_cast<uint64_t>(new Text{{1}, std::move(string)}) | 1)
+{
+  // Empty
+}
+
+const std::string& Value::string() const
+{
+  return reinterpret_cast<const Text*>(word & ~uint64_t(1))->text;
+}
+
+const void* Value::storage() const
+{
+  return isString() ? reinterpret_cast<const void*>(word & ~uint64_t(1)) : nullptr;
+}
+
+size_t Value::storageBytes() const
+{
+  if (isNumber())
+  {
+    return 0;
+  }
+
+  const std::string& rText = string();
+  bool inline_ = rText.data() >= reinterpret_cast<const char*>(&rText) && rText.data() < reinterpret_cast<const char*>(&rText + 1);
+  return sizeof(Text) + (inline_ ? 0 : rText.capacity() + 1);
+}
+
+void Value::retain() const
+{
+  // Strings can be shared between networks run on different threads
+  reinterpret_cast<Text*>(word & ~uint64_t(1))->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Value::release()
+{
+  Text* pText = reinterpret_cast<Text*>(word & ~uint64_t(1));
+
+  if (pText->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+  {
+    delete pText;
+  }
+}
+
 std::ostream& operator<<(std::ostream& rStream, const Value& val)
 {
-  std::visit([&](const auto& arg)
-    {
-      rStream << arg;
-    }, val);
+  if (val.isNumber())
+  {
+    rStream << val.number();
+  }
+  else
+  {
+    rStream << val.string();
+  }
 
   return rStream;
 }
 
+namespace
+{
+// Results that don't fit saturate toward the true result, so clamping them to
+// .range afterwards gives what unbounded arithmetic would have
+Number saturate(bool negative)
+{
+  return negative ? std::numeric_limits<Number>::min() : std::numeric_limits<Number>::max();
+}
+
+Number saturatingAdd(Number left, Number right)
+{
+  Number ret;
+  return __builtin_add_overflow(left, right, &ret) ? saturate(left < 0) : ret;
+}
+
+Number saturatingSub(Number left, Number right)
+{
+  Number ret;
+  return __builtin_sub_overflow(left, right, &ret) ? saturate(left < 0) : ret;
+}
+
+Number saturatingMul(Number left, Number right)
+{
+  Number ret;
+  return __builtin_mul_overflow(left, right, &ret) ? saturate((left < 0) != (right < 0)) : ret;
+}
+
+// The divisor must not be 0
+Number saturatingDiv(Number left, Number right)
+{
+  return right == -1 ? saturatingSub(0, left) : left / right;
+}
+
+// The divisor must not be 0
+Number safeMod(Number left, Number right)
+{
+  return right == -1 ? 0 : left % right;
+}
+
+// Kernels for the bulk file instructions, written as plain branch-free loops
+// so the compiler can vectorize them. FSUM falls back to a serial clamping
+// loop only for slices that could leave .range.
+bool anyString(const Value* pBegin, const Value* pEnd)
+{
+  bool ret = false;
+  for (const Value* pVal = pBegin; pVal != pEnd; pVal++)
+  {
+    ret |= pVal->isString();
+  }
+
+  return ret;
+}
+
+// The values must all be numbers
+Number minNumber(const Value* pBegin, const Value* pEnd, Number initial)
+{
+  Number ret = initial;
+  for (const Value* pVal = pBegin; pVal != pEnd; pVal++)
+  {
+    ret = std::min(ret, pVal->number());
+  }
+
+  return ret;
+}
+
+// The values must all be numbers
+Number maxNumber(const Value* pBegin, const Value* pEnd, Number initial)
+{
+  Number ret = initial;
+  for (const Value* pVal = pBegin; pVal != pEnd; pVal++)
+  {
+    ret = std::max(ret, pVal->number());
+  }
+
+  return ret;
+}
+
+// The values must all be numbers. Clamps after each one, as a loop of ADDI F X X
+// would, so the result doesn't depend on where the slices fall
+Number sumNumbers(const Value* pBegin, const Value* pEnd, Number initial, Number min, Number max)
+{
+  // Every running total lies between these bounds, so if they stay in range
+  // no clamp could fire and a plain sum gives the same result
+  Number count = pEnd - pBegin;
+  Number lowest = 0;
+  Number highest = 0;
+  bool fits = !__builtin_mul_overflow(minNumber(pBegin, pEnd, 0), count, &lowest) &&
+    !__builtin_mul_overflow(maxNumber(pBegin, pEnd, 0), count, &highest) &&
+    !__builtin_add_overflow(initial, lowest, &lowest) &&
+    !__builtin_add_overflow(initial, highest, &highest) &&
+    lowest >= min && highest <= max;
+
+  Number ret = initial;
+
+  if (fits)
+  {
+    for (const Value* pVal = pBegin; pVal != pEnd; pVal++)
+    {
+      ret += pVal->number();
+    }
+
+    return ret;
+  }
+
+  for (const Value* pVal = pBegin; pVal != pEnd; pVal++)
+  {
+    ret = std::clamp(saturatingAdd(ret, pVal->number()), min, max);
+  }
+
+  return ret;
+}
+} // namespace
+
 Value operator+(const Value& left, const Value& right)
 {
-  if (std::holds_alternative<Number>(left) && std::holds_alternative<Number>(right))
+  if (left.isNumber() && right.isNumber())
   {
-    return std::get<Number>(left) + std::get<Number>(right);
+    return saturatingAdd(left.number(), right.number());
   }
   else
   {
@@ -40,9 +209,9 @@ Value operator+(const Value& left, const Value& right)
 
 Value operator-(const Value& left, const Value& right)
 {
-  if (std::holds_alternative<Number>(left) && std::holds_alternative<Number>(right))
+  if (left.isNumber() && right.isNumber())
   {
-    return std::get<Number>(left) - std::get<Number>(right);
+    return saturatingSub(left.number(), right.number());
   }
   else
   {
@@ -52,9 +221,9 @@ Value operator-(const Value& left, const Value& right)
 
 Value operator*(const Value& left, const Value& right)
 {
-  if (std::holds_alternative<Number>(left) && std::holds_alternative<Number>(right))
+  if (left.isNumber() && right.isNumber())
   {
-    return std::get<Number>(left) * std::get<Number>(right);
+    return saturatingMul(left.number(), right.number());
   }
   else
   {
@@ -64,14 +233,14 @@ Value operator*(const Value& left, const Value& right)
 
 Value operator/(const Value& left, const Value& right)
 {
-  if (std::holds_alternative<Number>(left) && std::holds_alternative<Number>(right))
+  if (left.isNumber() && right.isNumber())
   {
-    if (std::get<Number>(right) == 0)
+    if (right.number() == 0)
     {
       throw MachineFailure("Tried to divide by zero");
     }
 
-    return std::get<Number>(left) / std::get<Number>(right);
+    return saturatingDiv(left.number(), right.number());
   }
   else
   {
@@ -81,14 +250,14 @@ Value operator/(const Value& left, const Value& right)
 
 Value operator%(const Value& left, const Value& right)
 {
-  if (std::holds_alternative<Number>(left) && std::holds_alternative<Number>(right))
+  if (left.isNumber() && right.isNumber())
   {
-    if (std::get<Number>(right) == 0)
+    if (right.number() == 0)
     {
       throw MachineFailure("Tried to divide by zero");
     }
 
-    return std::get<Number>(left) % std::get<Number>(right);
+    return safeMod(left.number(), right.number());
   }
   else
   {
@@ -98,41 +267,103 @@ Value operator%(const Value& left, const Value& right)
 
 bool operator<(const Value& left, const Value& right)
 {
-  if (left.index() != right.index())
+  if (left.isNumber() && right.isNumber())
   {
-    return false;
+    return left.number() < right.number();
   }
 
-  return std::visit([&](const auto& leftArg, const auto& rightArg)
-    {
-      return leftArg < rightArg;
-    }, left, right);
+  return left.isString() && right.isString() && left.string() < right.string();
 }
 
 bool operator==(const Value& left, const Value& right)
 {
-  if (left.index() != right.index())
+  if (left.identical(right))
   {
-    return false;
+    return true;
   }
 
-  return std::visit([&](const auto& leftArg, const auto& rightArg)
-    {
-      return leftArg == rightArg;
-    }, left, right);
+  return left.isString() && right.isString() && left.string() == right.string();
 }
 
 bool operator>(const Value& left, const Value& right)
 {
-  if (left.index() != right.index())
+  if (left.isNumber() && right.isNumber())
   {
-    return false;
+    return left.number() > right.number();
   }
 
-  return std::visit([&](const auto& leftArg, const auto& rightArg)
-    {
-      return leftArg > rightArg;
-    }, left, right);
+  return left.isString() && right.isString() && left.string() > right.string();
+}
+
+const char* toString(RunStats::Termination termination)
+{
+  switch (termination)
+  {
+    case RunStats::Termination::Completed:
+      return "completed";
+    case RunStats::Termination::CycleLimit:
+      return "cycle limit";
+    case RunStats::Termination::TimeLimit:
+      return "time limit";
+    case RunStats::Termination::MachineLimit:
+      return "machine limit";
+    case RunStats::Termination::MemoryLimit:
+      return "memory limit";
+  }
+
+  return "unknown";
+}
+
+const char* toString(StallReason reason)
+{
+  switch (reason)
+  {
+    case StallReason::SendM:
+      return "send M";
+    case StallReason::ReceiveM:
+      return "receive M";
+    case StallReason::LinkFull:
+      return "link full";
+    case StallReason::NodeFull:
+      return "node full";
+    case StallReason::None:
+      return "none";
+  }
+
+  return "unknown";
+}
+
+const char* toString(MemoryCategory category)
+{
+  switch (category)
+  {
+    case MemoryCategory::Files:
+      return "files";
+    case MemoryCategory::Machines:
+      return "machines";
+    case MemoryCategory::Names:
+      return "names";
+    case MemoryCategory::Strings:
+      return "strings";
+    case MemoryCategory::Code:
+      return "code";
+    case MemoryCategory::Channels:
+      return "channels";
+  }
+
+  return "unknown";
+}
+
+uint64_t totalBytes(const MemoryCounts& counts)
+{
+  uint64_t ret = 0;
+
+  for (const auto& rUsage : counts)
+  {
+    ret += rUsage.bytes;
+  }
+
+  return ret;
 }
 
 HwRegister::HwRegister(const std::string& name, Node* pNode)
@@ -240,6 +471,54 @@ void FileOutRegister::write(const Value& val)
   stream << val;
 }
 
+RecordingRegister::RecordingRegister(std::unique_ptr<HwRegister> pInner, InputRecorder& rRecorder, uint32_t index)
+  : HwRegister(pInner->name, pInner->pHost),
+    pInner(std::move(pInner)),
+    rRecorder(rRecorder),
+    index(index)
+{
+  // Empty
+}
+
+void RecordingRegister::write(const Value& val)
+{
+  pInner->write(val);
+}
+
+Value RecordingRegister::read()
+{
+  Value ret = pInner->read();
+
+  if (ret.isNumber())
+  {
+    rRecorder.number(index, ret.number());
+  }
+  else
+  {
+    rRecorder.string(index, ret.string());
+  }
+
+  return ret;
+}
+
+ReplayRegister::ReplayRegister(const std::string& name, Node* pNode, InputReplayer& rReplayer, uint32_t index)
+  : HwRegister(name, pNode),
+    rReplayer(rReplayer),
+    index(index)
+{
+  // Empty
+}
+
+Value ReplayRegister::read()
+{
+  if (rReplayer.registerRead(index) == InputRecord::Number)
+  {
+    return rReplayer.number();
+  }
+
+  return rReplayer.string();
+}
+
 std::ostream& operator<<(std::ostream& rStream, const Instruction& inst)
 {
   switch (inst.opcode)
@@ -331,6 +610,27 @@ std::ostream& operator<<(std::ostream& rStream, const Instruction& inst)
     case Instruction::Opcode::Repl:
       rStream << "REPL " << inst.op1;
       break;
+    case Instruction::Opcode::Chan:
+      rStream << "CHAN " << inst.op1;
+      break;
+    case Instruction::Opcode::Fsum:
+      rStream << "FSUM " << inst.op1;
+      break;
+    case Instruction::Opcode::Fmin:
+      rStream << "FMIN " << inst.op1;
+      break;
+    case Instruction::Opcode::Fmax:
+      rStream << "FMAX " << inst.op1;
+      break;
+    case Instruction::Opcode::Fcnt:
+      rStream << "FCNT " << inst.op1 << ' ' << inst.op2;
+      break;
+    case Instruction::Opcode::Ffnd:
+      rStream << "FFND " << inst.op1;
+      break;
+    case Instruction::Opcode::Fill:
+      rStream << "FILL " << inst.op1;
+      break;
     case Instruction::Opcode::Dump0:
       rStream << "DUMP";
       break;
@@ -362,7 +662,43 @@ std::ostream& operator<<(std::ostream& rStream, const Instruction::Register& reg
   return rStream;
 }
 
-std::ostream& operator<<(std::ostream& rStream, const HwRegister* const hwreg)
+std::ostream& operator<<(std::ostream& rStream, const Instruction::Route& route)
+{
+  rStream << route.id;
+  return rStream;
+}
+
+std::ostream& operator<<(std::ostream& rStream, const Instruction::SwizMask& mask)
+{
+  rStream << mask.mask;
+  return rStream;
+}
+
+Instruction::SwizMask compileSwizMask(Number mask)
+{
+  Instruction::SwizMask ret{mask, {}, 0, 0, mask < 0};
+  std::string maskStr = std::to_string(mask);
+
+  for (char c : maskStr)
+  {
+    if (c == '-')
+    {
+      continue;
+    }
+
+    uint8_t pick = c == '0' ? 9 : static_cast<uint8_t>(c - '1');
+    ret.picks[ret.length++] = pick;
+
+    if (pick < 9)
+    {
+      ret.digits = std::max<uint8_t>(ret.digits, pick + 1);
+    }
+  }
+
+  return ret;
+}
+
+std::ostream& operator<<(std::ostream& rStream, const HwRegisterSpec* const hwreg)
 {
   rStream << hwreg->name;
   return rStream;
@@ -495,122 +831,452 @@ std::ostream& operator<<(std::ostream& s, const File& f)
   return s;
 }
 
-std::unique_ptr<Machine> Machine::repl(size_t address)
+size_t MachineTable::size() const
 {
-  auto pRet = std::make_unique<Machine>();
-  pRet->name = name + ":" + std::to_string(replCount++);
-  pRet->x = x;
-  pRet->t = t;
-  pRet->code = code;
-  pRet->instPtr = address;
-  pRet->replCount = 0;
-  pRet->globalMode = globalMode;
-  pRet->terminated = false;
-  return pRet;
+  return instPtr.size();
 }
 
-bool Machine::done() const
+bool MachineTable::empty() const
 {
-  return instPtr >= code.size();
+  return instPtr.empty();
 }
 
-std::ostream& operator<<(std::ostream& s, const Machine& m)
+bool MachineTable::done(size_t index) const
 {
-  s << "Machine{name=" << m.name << "; x=" << m.x << "; t=" << m.t << "; file=";
+  return instPtr[index] >= program[index]->code.size();
+}
+
+MachineId MachinePool::create(const Program* pProgram)
+{
+  MachineId ret = allocate();
+  MachineInfo& rInfo = records[ret];
+  rInfo.pProgram = pProgram;
+  rInfo.parent = noParent;
+  rInfo.replIndex = 0;
+  liveCount++;
+  return ret;
+}
+
+MachineId MachinePool::replicate(MachineId parent)
+{
+  MachineId ret = allocate();
+  MachineInfo& rParent = records[parent];
+  MachineInfo& rInfo = records[ret];
+  rInfo.pProgram = rParent.pProgram;
+  rInfo.parent = parent;
+  rInfo.replIndex = rParent.replCount++;
+  rParent.refs++;
+  liveCount++;
+  return ret;
+}
+
+void MachinePool::release(MachineId id)
+{
+  liveCount--;
 
-  if (m.file)
+  while (id != noParent && --records[id].refs == 0)
   {
-    s << "{" << *m.file << "}";
+    MachineId parent = records[id].parent;
+    records[id].file.reset();
+    freeList.push_back(id);
+    id = parent;
   }
-  else
+}
+
+std::string MachinePool::name(MachineId id) const
+{
+  std::vector<uint32_t> path;
+
+  while (records[id].parent != noParent)
   {
-    s << "<none>";
+    path.push_back(records[id].replIndex);
+    id = records[id].parent;
   }
 
-  s << "; instPtr=" << m.instPtr << '}';
+  std::string ret = records[id].pProgram->name;
 
-  return s;
+  for (auto iter = path.rbegin(); iter != path.rend(); ++iter)
+  {
+    ret += ':';
+    ret += std::to_string(*iter);
+  }
+
+  return ret;
 }
 
-Instruction::Instruction(Opcode opcode, Operand op1, Operand op2, Operand op3)
-  : opcode(opcode),
-    op1(op1),
-    op2(op2),
-    op3(op3)
+MachineInfo& MachinePool::operator[](MachineId id)
 {
-  // Empty
+  return records[id];
 }
 
-bool Channel::send(const Value& value)
+const MachineInfo& MachinePool::operator[](MachineId id) const
 {
-  if (val.has_value())
-  {
-    return false;
-  }
+  return records[id];
+}
 
-  val = value;
-  return true;
+size_t MachinePool::live() const
+{
+  return liveCount;
 }
 
-bool Channel::available() const
+size_t MachinePool::capacity() const
 {
-  return val.has_value();
+  return records.size();
 }
 
-std::optional<Value> Channel::receive()
+MachineId MachinePool::allocate()
 {
-  std::optional<Value> ret;
-  ret.swap(val);
+  MachineId ret = 0;
+
+  if (freeList.empty())
+  {
+    ret = static_cast<MachineId>(records.size());
+    records.emplace_back();
+  }
+  else
+  {
+    ret = freeList.back();
+    freeList.pop_back();
+  }
+
+  records[ret].replCount = 0;
+  records[ret].refs = 1;
   return ret;
 }
 
-bool Node::operator==(const std::string& str)
+void MachineTable::add(const Program* pProgram, MachineId machineId)
 {
-  return name == str;
+  instPtr.push_back(0);
+  program.push_back(pProgram);
+  x.emplace_back(0);
+  t.emplace_back(0);
+  sendingM.push_back(false);
+  globalMode.push_back(true);
+  channel.push_back(0);
+  terminated.push_back(false);
+  id.push_back(machineId);
 }
 
-bool Node::full() const
+void MachineTable::repl(size_t index, Instruction::Address address, MachineId machineId, MachineTable& rDest)
 {
-  return machines.size() + files.size() + incomingMachines.size() >= capacity;
+  rDest.instPtr.push_back(address);
+  rDest.program.push_back(program[index]);
+  rDest.x.push_back(x[index]);
+  rDest.t.push_back(t[index]);
+  rDest.sendingM.push_back(false);
+  rDest.globalMode.push_back(globalMode[index]);
+  rDest.channel.push_back(channel[index]);
+  rDest.terminated.push_back(false);
+  rDest.id.push_back(machineId);
 }
 
-Network::Network(const std::filesystem::path& path)
-  : rangeMin(-9999),
-  rangeMax(9999),
-  nextFileId(400),
-  nodes(),
-  globalChannel(),
-  pHomeNode(),
-  hwRegMap(),
-  pMachineBeingAssembled(),
-  addressLookup(),
-  repLines(),
-  addRepLines(false),
-  repCount(0),
-  random(4604955068226825093l),
-  stats()
+void MachineTable::transfer(size_t index, MachineTable& rDest)
 {
-  std::ifstream stream(path);
-  size_t lineno = 0;
-
-  while (stream)
-  {
-    ++lineno;
-    std::string line;
-    std::getline(stream, line);
+  rDest.instPtr.push_back(instPtr[index]);
+  rDest.program.push_back(program[index]);
+  rDest.x.push_back(std::move(x[index]));
+  rDest.t.push_back(std::move(t[index]));
+  rDest.sendingM.push_back(sendingM[index]);
+  rDest.globalMode.push_back(globalMode[index]);
+  rDest.channel.push_back(channel[index]);
+  rDest.terminated.push_back(terminated[index]);
+  rDest.id.push_back(id[index]);
+}
 
-    // Remove comments
+void MachineTable::transferAll(MachineTable& rDest)
+{
+  auto moveAll = [](auto& rFrom, auto& rTo)
     {
-      size_t commentStart = line.find(';');
-      if (commentStart != std::string::npos)
-      {
-        line = line.substr(0, commentStart);
-      }
+      rTo.insert(rTo.end(), std::make_move_iterator(rFrom.begin()), std::make_move_iterator(rFrom.end()));
+      rFrom.clear();
+    };
+
+  moveAll(instPtr, rDest.instPtr);
+  moveAll(program, rDest.program);
+  moveAll(x, rDest.x);
+  moveAll(t, rDest.t);
+  moveAll(sendingM, rDest.sendingM);
+  moveAll(globalMode, rDest.globalMode);
+  moveAll(channel, rDest.channel);
+  moveAll(terminated, rDest.terminated);
+  moveAll(id, rDest.id);
+}
 
-      std::string upperLine(line);
-      std::transform(upperLine.begin(), upperLine.end(), upperLine.begin(), ::toupper);
+void MachineTable::move(size_t from, size_t to)
+{
+  instPtr[to] = instPtr[from];
+  program[to] = program[from];
+  x[to] = std::move(x[from]);
+  t[to] = std::move(t[from]);
+  sendingM[to] = sendingM[from];
+  globalMode[to] = globalMode[from];
+  channel[to] = channel[from];
+  terminated[to] = terminated[from];
+  id[to] = id[from];
+}
 
-      commentStart = upperLine.find("NOTE");
+void MachineTable::truncate(size_t count)
+{
+  instPtr.resize(count);
+  program.resize(count);
+  x.resize(count);
+  t.resize(count);
+  sendingM.resize(count);
+  globalMode.resize(count);
+  channel.resize(count);
+  terminated.resize(count);
+  id.resize(count);
+}
+
+void MachineTable::print(std::ostream& s, size_t index, const MachinePool& pool) const
+{
+  const MachineInfo& rInfo = pool[id[index]];
+
+  s << "Machine{name=" << pool.name(id[index]) << "; x=" << x[index] << "; t=" << t[index] << "; file=";
+
+  if (rInfo.file)
+  {
+    s << "{" << *rInfo.file << "}";
+  }
+  else
+  {
+    s << "<none>";
+  }
+
+  s << "; instPtr=" << instPtr[index] << '}';
+}
+
+Instruction::Instruction(Opcode opcode, Operand op1, Operand op2, Operand op3)
+  : opcode(opcode),
+    op1(op1),
+    op2(op2),
+    op3(op3)
+{
+  // Empty
+}
+
+bool Channel::full() const
+{
+  return count >= depth;
+}
+
+bool Channel::send(const Value& value)
+{
+  if (full())
+  {
+    return false;
+  }
+
+  if (buffer.empty())
+  {
+    buffer.resize(depth);
+  }
+
+  size_t tail = head + count;
+  if (tail >= depth)
+  {
+    tail -= depth;
+  }
+
+  buffer[tail] = value;
+  count++;
+  stats.sends++;
+  return true;
+}
+
+void Channel::enqueue(MachineId machine, const Value& value, MachinePool& rPool)
+{
+  waiting.push_back(Sender{machine, value});
+  rPool[machine].pSendChannel = this;
+
+  stats.queuedSends++;
+  stats.peakQueue = std::max(stats.peakQueue, waiting.size());
+}
+
+void Channel::cancel(MachineId machine)
+{
+  auto iter = std::find_if(waiting.begin(), waiting.end(),
+    [machine](const Sender& rSender)
+    {
+      return rSender.machine == machine;
+    });
+
+  if (iter != waiting.end())
+  {
+    waiting.erase(iter);
+  }
+}
+
+bool Channel::available() const
+{
+  return count > 0;
+}
+
+bool Channel::deliver(MachineId machine, MachinePool& rPool)
+{
+  if (full() || waiting.front().machine != machine)
+  {
+    return false;
+  }
+
+  send(waiting.front().value);
+  waiting.pop_front();
+  rPool[machine].pSendChannel = nullptr;
+  return true;
+}
+
+std::optional<Value> Channel::receive()
+{
+  std::optional<Value> ret;
+
+  if (count > 0)
+  {
+    ret = std::move(buffer[head]);
+    count--;
+
+    if (++head == depth)
+    {
+      head = 0;
+    }
+
+    stats.receives++;
+  }
+
+  return ret;
+}
+
+bool Node::operator==(const std::string& str)
+{
+  return name == str;
+}
+
+bool Node::full() const
+{
+  return occupancy >= capacity;
+}
+
+Node* Node::link(int16_t id) const
+{
+  auto iter = std::lower_bound(links.begin(), links.end(), id,
+    [](const std::pair<int16_t, Node*>& rLink, int16_t id)
+    {
+      return rLink.first < id;
+    });
+
+  if (iter == links.end() || iter->first != id)
+  {
+    return nullptr;
+  }
+
+  return iter->second;
+}
+
+bool Node::addLink(int16_t id, Node& rTarget)
+{
+  auto iter = std::lower_bound(links.begin(), links.end(), id,
+    [](const std::pair<int16_t, Node*>& rLink, int16_t id)
+    {
+      return rLink.first < id;
+    });
+
+  if (iter != links.end() && iter->first == id)
+  {
+    return false;
+  }
+
+  links.emplace(iter, id, &rTarget);
+  return true;
+}
+
+void Node::addFile(File&& file)
+{
+  uint16_t id = file.id;
+
+  if (files.emplace(id, std::move(file)).second)
+  {
+    occupancy++;
+  }
+}
+
+void Node::retireMachine(size_t index, MachinePool& rPool)
+{
+  MachineId id = machines.id[index];
+
+  if (rPool[id].pSendChannel)
+  {
+    rPool[id].pSendChannel->cancel(id);
+    rPool[id].pSendChannel = nullptr;
+  }
+
+  if (rPool[id].file)
+  {
+    addFile(std::move(*rPool[id].file));
+  }
+
+  rPool.release(id);
+  occupancy--;
+}
+
+Script::Script(const std::filesystem::path& path)
+  : path(path),
+  sourceText(),
+  rangeMin(-9999),
+  rangeMax(9999),
+  bulk(false),
+  nodes(),
+  links(),
+  files(),
+  registers(),
+  channels{{0, 1}},
+  programs(),
+  routeSlots(std::numeric_limits<uint16_t>::max() + 1, 0),
+  routeSlotCount(1),
+  size(0),
+  homeNode(),
+  nodeLoad(),
+  linkKeys(),
+  hwRegMap(),
+  pProgramBeingAssembled(),
+  addressLookup(),
+  repLines(),
+  addRepLines(false),
+  repCount(0),
+  repStartLine(0),
+  currentSource()
+{
+  std::ifstream stream(path);
+  size_t lineno = 0;
+
+  if (!stream)
+  {
+    throw Error("Could not open script: " + path.string());
+  }
+
+  while (stream)
+  {
+    ++lineno;
+    std::string line;
+    std::getline(stream, line);
+
+    if (stream)
+    {
+      sourceText.push_back(line);
+    }
+
+    currentSource = SourceLine{static_cast<uint32_t>(lineno), 0, 0};
+
+    // Remove comments
+    {
+      size_t commentStart = line.find(';');
+      if (commentStart != std::string::npos)
+      {
+        line = line.substr(0, commentStart);
+      }
+
+      std::string upperLine(line);
+      std::transform(upperLine.begin(), upperLine.end(), upperLine.begin(), ::toupper);
+
+      commentStart = upperLine.find("NOTE");
       if (commentStart != std::string::npos)
       {
         line = line.substr(0, commentStart);
@@ -667,7 +1333,7 @@ Network::Network(const std::filesystem::path& path)
     }
     else
     {
-      if (!pMachineBeingAssembled)
+      if (!pProgramBeingAssembled)
       {
         throw Error("Encountered instruction before .start command");
       }
@@ -682,7 +1348,7 @@ Network::Network(const std::filesystem::path& path)
       {
         if (addRepLines)
         {
-          repLines.push_back(line);
+          repLines.emplace_back(static_cast<uint32_t>(lineno), line);
         }
         else
         {
@@ -693,112 +1359,1146 @@ Network::Network(const std::filesystem::path& path)
   }
 
   finalizeActiveMachine();
+  assignRouteSlots();
+  clampSwizMasks();
 }
 
-RunStats Network::run()
+
+void Script::processConfigDirective(const std::string& line)
 {
-  size_t machinesRemaining = 0;
-  do
+  static std::regex rangeStmt(R"r(\.range (-?\d+) (-?\d+))r", std::regex_constants::ECMAScript | std::regex_constants::icase);
+  static std::regex nodeStmt(R"r(\.node (\w+)(?: (\d+))?)r", std::regex_constants::ECMAScript | std::regex_constants::icase);
+  static std::regex linkStmt(R"r(\.link \((\w+) (-?\d+)\) \((\w+)(?: (-?\d+))?\))r", std::regex_constants::ECMAScript | std::regex_constants::icase);
+  static std::regex fileStmt(R"r(\.file "(.*)" (\w+) (\d+) (rw|ro) (word|byte) (noint|int)(?: (locked))?)r", std::regex_constants::ECMAScript | std::regex_constants::icase);
+  static std::regex regStmt(R"r(\.reg (sink|file_out|file_in|rand|stdin|stdout|stderr) (#[A-Z]+) (\w+)(?: "?(.*)"?)?)r", std::regex_constants::ECMAScript | std::regex_constants::icase);
+  static std::regex startStmt(R"r(\.start (\w+))r", std::regex_constants::ECMAScript | std::regex_constants::icase);
+  static std::regex homeStmt(R"r(\.home (\w+))r", std::regex_constants::ECMAScript | std::regex_constants::icase);
+  static std::regex channelStmt(R"r(\.channel (\d+)(?: (\d+))?)r", std::regex_constants::ECMAScript | std::regex_constants::icase);
+  static std::regex bulkStmt(R"r(\.bulk)r", std::regex_constants::ECMAScript | std::regex_constants::icase);
+
+  std::smatch match;
+
+  if (std::regex_match(line, match, rangeStmt))
   {
-    stats.cycles++;
-    machinesRemaining = 0;
+    rangeMin = std::stol(match[1]);
+    rangeMax = std::stol(match[2]);
 
-    for (auto& rNode : nodes)
+    if (rangeMin < Value::min || rangeMax > Value::max)
     {
-      for (auto& rpMachine : rNode.machines)
-      {
-        bool advance = true;
+      throw Error("Range is too wide; values must fit in 63 bits");
+    }
+  }
+  else if (std::regex_match(line, match, nodeStmt))
+  {
+    NodeSpec node;
+    node.name = match[1];
 
-        try
-        {
-          if (rpMachine->outM.has_value())
-          {
-            advance = set(rNode, *rpMachine, Instruction::Register::M, rpMachine->outM.value());
-            if (advance)
-            {
-              rpMachine->outM.reset();
-            }
-          }
-          else
-          {
-            if (rpMachine->instPtr >= rpMachine->code.size())
-            {
-              throw MachineFailure("No more instructions");
-            }
+    if (match[2].matched)
+    {
+      node.capacity = std::stoul(match[2]);
+    }
+    else
+    {
+      node.capacity = std::numeric_limits<size_t>::max();
+    }
 
-            const Instruction& inst = rpMachine->code[rpMachine->instPtr];
+    nodes.emplace_back(std::move(node));
+    nodeLoad.push_back(0);
+  }
+  else if (std::regex_match(line, match, linkStmt))
+  {
+    size_t fromNode = findNode(match[1], "Tried to link from unknown node");
+    size_t toNode = findNode(match[3], "Tried to link to unknown node");
 
-            switch (inst.opcode)
-            {
-              case Instruction::Opcode::Copy:
-              {
-                std::optional<Value> val = get(rNode, *rpMachine, inst.op1);
-                advance = val.has_value() && set(rNode, *rpMachine, inst.op2, val.value());
-                break;
-              }
-              case Instruction::Opcode::Addi:
-              {
-                std::optional<Value> left = get(rNode, *rpMachine, inst.op1);
-                std::optional<Value> right = get(rNode, *rpMachine, inst.op2);
-                advance = left && right && set(rNode, *rpMachine, inst.op3, *left + *right);
-                break;
-              }
-              case Instruction::Opcode::Subi:
-              {
-                std::optional<Value> left = get(rNode, *rpMachine, inst.op1);
-                std::optional<Value> right = get(rNode, *rpMachine, inst.op2);
-                advance = left && right && set(rNode, *rpMachine, inst.op3, *left - *right);
-                break;
-              }
-              case Instruction::Opcode::Muli:
-              {
-                std::optional<Value> left = get(rNode, *rpMachine, inst.op1);
-                std::optional<Value> right = get(rNode, *rpMachine, inst.op2);
-                advance = left && right && set(rNode, *rpMachine, inst.op3, *left * *right);
-                break;
-              }
-              case Instruction::Opcode::Divi:
-              {
-                std::optional<Value> left = get(rNode, *rpMachine, inst.op1);
-                std::optional<Value> right = get(rNode, *rpMachine, inst.op2);
-                advance = left && right && set(rNode, *rpMachine, inst.op3, *left / *right);
-                break;
-              }
-              case Instruction::Opcode::Modi:
-              {
-                std::optional<Value> left = get(rNode, *rpMachine, inst.op1);
-                std::optional<Value> right = get(rNode, *rpMachine, inst.op2);
-                advance = left && right && set(rNode, *rpMachine, inst.op3, *left % *right);
-                break;
-              }
-              case Instruction::Opcode::Swiz:
-              {
-                std::optional<Value> input = get(rNode, *rpMachine, inst.op1);
-                std::optional<Value> mask = get(rNode, *rpMachine, inst.op2);
+    int16_t fromNum = static_cast<int16_t>(std::stoi(match[2]));
 
-                if (input && mask)
-                {
-                  Value swizzed = swiz(*input, *mask);
-                  advance = set(rNode, *rpMachine, inst.op3, swizzed);
-                }
-                else
-                {
-                  advance = false;
-                }
+    bool inserted = linkKeys.emplace(fromNode, fromNum).second;
+    if (!inserted)
+    {
+      throw Error("Tried to replace existing link");
+    }
 
-                break;
-              }
-              case Instruction::Opcode::Jump:
-              {
-                if (std::holds_alternative<Instruction::Address>(inst.op1))
-                {
-                  rpMachine->instPtr = std::get<Instruction::Address>(inst.op1);
-                  advance = false;
-                }
-                else
-                {
-                  throw Error("Jump address is incorrect type");
-                }
+    links.push_back({fromNode, fromNum, toNode});
+
+    if (match[4].matched)
+    {
+      int16_t toNum = static_cast<int16_t>(std::stoi(match[4]));
+      inserted = linkKeys.emplace(toNode, toNum).second;
+      if (!inserted)
+      {
+        throw Error("Tried to replace existing link");
+      }
+
+      links.push_back({toNode, toNum, fromNode});
+    }
+  }
+  else if (std::regex_match(line, match, fileStmt))
+  {
+    FileSpec spec;
+
+    spec.node = findNode(match[2], "Tried to add file to unknown node");
+    spec.readBytes = "byte" == match[5];
+    spec.parseInts = "int" == match[6];
+
+    File& rFile = spec.file;
+    rFile.filename = std::filesystem::absolute(match[1].str());
+    rFile.id = static_cast<uint16_t>(std::stoul(match[3]));
+    rFile.readonly = "ro" == match[4];
+    rFile.locked = match[7].matched;
+
+    rFile.initFromDisk(spec.readBytes, spec.parseInts);
+
+    bool duplicate = std::any_of(files.begin(), files.end(), [&](const FileSpec& rOther)
+      {
+        return rOther.node == spec.node && rOther.file.id == rFile.id;
+      });
+
+    if (nodeLoad[spec.node] >= nodes[spec.node].capacity)
+    {
+      throw Error("Tried to add file to node, but node is already full");
+    }
+
+    // Like Node::addFile, the first file with a given ID wins
+    if (!duplicate)
+    {
+      nodeLoad[spec.node]++;
+      files.push_back(std::move(spec));
+    }
+  }
+  else if (std::regex_match(line, match, regStmt))
+  {
+    size_t node = findNode(match[3], "Tried to add hardware register to unknown node");
+
+    bool duplicate = std::any_of(registers.begin(), registers.end(), [&](const auto& rpOther)
+      {
+        return rpOther->node == node && rpOther->name == match[2];
+      });
+
+    if (duplicate)
+    {
+      throw Error("Tried to add duplicate hardware register");
+    }
+
+    if (!match[4].matched)
+    {
+      if (match[1] == "rand")
+      {
+        throw Error("Tried to create rand register without seed");
+      }
+      else if (match[1] == "file_in")
+      {
+        throw Error("Tried to create file_in register without filename");
+      }
+      else if (match[1] == "file_out")
+      {
+        throw Error("Tried to create file_out register without filename");
+      }
+    }
+
+    auto pSpec = std::make_unique<HwRegisterSpec>();
+    pSpec->name = match[2];
+    pSpec->kind = match[1];
+    pSpec->arg = match[4];
+    pSpec->node = node;
+    pSpec->index = registers.size();
+
+    std::string lower(match[2]);
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+
+    hwRegMap.emplace(lower, pSpec.get());
+    registers.push_back(std::move(pSpec));
+  }
+  else if (std::regex_match(line, match, startStmt))
+  {
+    finalizeActiveMachine();
+    pProgramBeingAssembled = std::make_unique<Program>();
+    pProgramBeingAssembled->name = match[1];
+  }
+  else if (std::regex_match(line, match, homeStmt))
+  {
+    homeNode = findNode(match[1], "Tried to set home to unrecognized node");
+  }
+  else if (std::regex_match(line, match, channelStmt))
+  {
+    Number id = std::stol(match[1]);
+    size_t depth = match[2].matched ? std::stoul(match[2]) : 1;
+
+    if (depth == 0)
+    {
+      throw Error("Channel depth must be at least 1");
+    }
+
+    auto iter = std::find_if(channels.begin(), channels.end(), [&](const ChannelSpec& rChannel)
+      {
+        return rChannel.id == id;
+      });
+
+    if (iter == channels.end())
+    {
+      if (channels.size() > std::numeric_limits<uint16_t>::max())
+      {
+        throw Error("Too many channels");
+      }
+
+      channels.push_back({id, depth});
+    }
+    else if (id != 0)
+    {
+      throw Error("Tried to redeclare channel");
+    }
+    else
+    {
+      iter->depth = depth;
+    }
+  }
+  else if (std::regex_match(line, match, bulkStmt))
+  {
+    // Only programs that follow can use them
+    bulk = true;
+  }
+  else
+  {
+    throw Error("Unrecognized config directive: " + line);
+  }
+}
+
+void Script::processPreprocessorDirective(const std::string& line)
+{
+  if (line.find("@rep") == 0)
+  {
+    repCount = std::stoul(line.data() + 5);
+    addRepLines = true;
+    repStartLine = currentSource.line;
+  }
+  else if (line.find("@end") == 0)
+  {
+    if (!addRepLines)
+    {
+      throw Error("Found @end without corresponding @rep");
+    }
+
+    addRepLines = false;
+
+    static std::regex incrementor(R"r((.*)@\{(-?\d+),(-?\d+)\}(.*))r");
+
+    for (size_t i = 0; i < repCount; i++)
+    {
+      for (const auto& rPair : repLines)
+      {
+        const std::string& line = rPair.second;
+        currentSource = SourceLine{rPair.first, repStartLine, static_cast<uint32_t>(i)};
+
+        std::smatch match;
+        if (std::regex_search(line, match, incrementor))
+        {
+          Number start = std::stol(match[2]);
+          Number inc = std::stol(match[3]);
+
+          std::ostringstream procLine;
+          procLine << match[1] << start + inc * i << match[4];
+
+          processInstruction(procLine.str());
+        }
+        else
+        {
+          processInstruction(line);
+        }
+      }
+    }
+
+    repLines.clear();
+  }
+}
+
+void Script::processInstruction(const std::string& line)
+{
+  static std::regex noArgs(R"((halt|kill|mode|make|drop|wipe|noop|dump))");
+  static std::regex singleArg(R"((mark|repl|jump|tjmp|fjmp|test|link|host|void|grab|file|seek|rand|chan|dump|fsum|fmin|fmax|ffnd|fill)\s+(\S+))");
+  static std::regex doubleArg(R"((copy|fcnt)\s+(\S+)\s+(\S+))");
+  static std::regex tripleArg(R"((addi|subi|muli|divi|modi|swiz|test)\s+(\S+)\s+(\S+)\s+(\S+))");
+
+  std::smatch match;
+
+  if (std::regex_match(line, match, noArgs))
+  {
+    processNoArgs(match[1]);
+  }
+  else if (std::regex_match(line, match, singleArg))
+  {
+    processSingleArg(match[1], match[2]);
+  }
+  else if (std::regex_match(line, match, doubleArg))
+  {
+    processDoubleArg(match[1], match[2], match[3]);
+  }
+  else if (std::regex_match(line, match, tripleArg))
+  {
+    processTripleArg(match[1], match[2], match[3], match[4]);
+  }
+  else
+  {
+    throw Error("Unrecognized or invalid instruction: " + line);
+  }
+
+  pProgramBeingAssembled->source.resize(pProgramBeingAssembled->code.size(), currentSource);
+}
+
+void Script::processNoArgs(const std::string& mne)
+{
+  static std::map<std::string, Instruction::Opcode> opcodeMap = {
+    {"halt", Instruction::Opcode::Halt},
+    {"kill", Instruction::Opcode::Kill},
+    {"mode", Instruction::Opcode::Mode},
+    {"make", Instruction::Opcode::Make},
+    {"drop", Instruction::Opcode::Drop},
+    {"wipe", Instruction::Opcode::Wipe},
+    {"noop", Instruction::Opcode::Noop},
+    {"dump", Instruction::Opcode::Dump0}
+  };
+
+  auto iter = opcodeMap.find(mne);
+  if (iter == opcodeMap.end())
+  {
+    throw Error("Unrecognized mnemonic: " + mne);
+  }
+
+  pProgramBeingAssembled->code.emplace_back(iter->second);
+}
+
+void Script::processSingleArg(const std::string& mne, const std::string& op1)
+{
+  if (mne == "mark")
+  {
+    addressLookup.emplace(op1, pProgramBeingAssembled->code.size());
+  }
+  else if (mne == "repl")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Repl, op1);
+  }
+  else if (mne == "jump")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Jump, op1);
+  }
+  else if (mne == "tjmp")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Tjmp, op1);
+  }
+  else if (mne == "fjmp")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Fjmp, op1);
+  }
+  else if (mne == "test")
+  {
+    if (op1 == "mrd")
+    {
+      pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Test1, Instruction::Register::M);
+    }
+    else if (op1 == "eof")
+    {
+      pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Test1, Instruction::Register::F);
+    }
+  }
+  else if (mne == "link")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Link, linkTarget(op1));
+  }
+  else if (mne == "host")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Host, reg(op1));
+  }
+  else if (mne == "void")
+  {
+    if (op1 == "m")
+    {
+      pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Void, Instruction::Register::M);
+    }
+    else if (op1 == "f")
+    {
+      pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Void, Instruction::Register::F);
+    }
+    else
+    {
+      throw Error("Void only accepts M or F");
+    }
+  }
+  else if (mne == "grab")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Grab, regOrVal(op1));
+  }
+  else if (mne == "file")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::File, reg(op1));
+  }
+  else if (mne == "seek")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Seek, regOrVal(op1));
+  }
+  else if (mne == "rand")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Rand, reg(op1));
+  }
+  else if (mne == "chan")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Chan, regOrVal(op1));
+  }
+  else if (mne == "dump")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Dump1, op1);
+  }
+  else if (mne == "fsum")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Fsum, bulkOperand(mne, op1, false));
+  }
+  else if (mne == "fmin")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Fmin, bulkOperand(mne, op1, false));
+  }
+  else if (mne == "fmax")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Fmax, bulkOperand(mne, op1, false));
+  }
+  else if (mne == "ffnd")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Ffnd, bulkOperand(mne, op1, true));
+  }
+  else if (mne == "fill")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Fill, bulkOperand(mne, op1, true));
+  }
+  else
+  {
+    throw Error("Unrecognized mnemonic: " + mne);
+  }
+}
+
+void Script::processDoubleArg(const std::string& mne, const std::string& op1, const std::string& op2)
+{
+  if (mne == "copy")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Copy, regOrVal(op1), reg(op2));
+  }
+  else if (mne == "fcnt")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Fcnt, bulkOperand(mne, op1, true), bulkOperand(mne, op2, false));
+  }
+  else
+  {
+    throw Error("Unrecognized mnemonic: " + mne);
+  }
+
+  int numM = 0;
+
+  numM += (std::holds_alternative<Instruction::Register>(pProgramBeingAssembled->code.back().op1) && std::get<Instruction::Register>(pProgramBeingAssembled->code.back().op1) == Instruction::Register::M) ? 1 : 0;
+  numM += (std::holds_alternative<Instruction::Register>(pProgramBeingAssembled->code.back().op2) && std::get<Instruction::Register>(pProgramBeingAssembled->code.back().op2) == Instruction::Register::M) ? 1 : 0;
+
+  if (numM > 1)
+  {
+    throw Error("Referenced M register too many times in one instruction");
+  }
+}
+
+void Script::processTripleArg(const std::string& mne, const std::string& op1, const std::string& op2, const std::string& op3)
+{
+  // addi|subi|muli|divi|modi|swiz|test
+
+  if (mne == "addi")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Addi, regOrVal(op1), regOrVal(op2), reg(op3));
+  }
+  else if (mne == "subi")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Subi, regOrVal(op1), regOrVal(op2), reg(op3));
+  }
+  else if (mne == "muli")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Muli, regOrVal(op1), regOrVal(op2), reg(op3));
+  }
+  else if (mne == "divi")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Divi, regOrVal(op1), regOrVal(op2), reg(op3));
+  }
+  else if (mne == "modi")
+  {
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Modi, regOrVal(op1), regOrVal(op2), reg(op3));
+  }
+  else if (mne == "swiz")
+  {
+    Instruction::Operand mask = regOrVal(op2);
+
+    if (std::holds_alternative<Number>(mask))
+    {
+      mask = compileSwizMask(std::get<Number>(mask));
+    }
+
+    pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::Swiz, regOrVal(op1), mask, reg(op3));
+  }
+  else if (mne == "test")
+  {
+    if (op2 == "<")
+    {
+      pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::TestLt, regOrVal(op1), regOrVal(op3));
+    }
+    else if (op2 == "=")
+    {
+      pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::TestEq, regOrVal(op1), regOrVal(op3));
+    }
+    else if (op2 == ">")
+    {
+      pProgramBeingAssembled->code.emplace_back(Instruction::Opcode::TestGt, regOrVal(op1), regOrVal(op3));
+    }
+  }
+  else
+  {
+    throw Error("Unrecognized mnemonic: " + mne);
+  }
+
+  int numM = 0;
+
+  numM += (std::holds_alternative<Instruction::Register>(pProgramBeingAssembled->code.back().op1) && std::get<Instruction::Register>(pProgramBeingAssembled->code.back().op1) == Instruction::Register::M) ? 1 : 0;
+  numM += (std::holds_alternative<Instruction::Register>(pProgramBeingAssembled->code.back().op2) && std::get<Instruction::Register>(pProgramBeingAssembled->code.back().op2) == Instruction::Register::M) ? 1 : 0;
+  numM += (std::holds_alternative<Instruction::Register>(pProgramBeingAssembled->code.back().op3) && std::get<Instruction::Register>(pProgramBeingAssembled->code.back().op3) == Instruction::Register::M) ? 1 : 0;
+
+  if (numM > 1)
+  {
+    throw Error("Referenced M register too many times in one instruction");
+  }
+}
+
+void Script::finalizeActiveMachine()
+{
+  if (pProgramBeingAssembled)
+  {
+    if (addRepLines)
+    {
+      throw Error("Missing @end after @rep");
+    }
+
+    if (!homeNode)
+    {
+      throw Error("Tried to finalize machine before home node was set");
+    }
+
+    if (nodeLoad[*homeNode] < nodes[*homeNode].capacity)
+    {
+      size_t curAddr = 0;
+
+      for (auto& rInst : pProgramBeingAssembled->code)
+      {
+        if (rInst.opcode == Instruction::Opcode::Jump ||
+          rInst.opcode == Instruction::Opcode::Tjmp ||
+          rInst.opcode == Instruction::Opcode::Fjmp ||
+          rInst.opcode == Instruction::Opcode::Repl)
+        {
+          std::string label = std::get<std::string>(rInst.op1);
+          auto iter = addressLookup.find(label);
+          if (iter == addressLookup.end())
+          {
+            throw Error("Tried to jump/repl to unrecognized label: " + label);
+          }
+
+          rInst.op1 = iter->second;
+        }
+      }
+
+      size += pProgramBeingAssembled->code.size();
+      pProgramBeingAssembled->home = *homeNode;
+      pProgramBeingAssembled->index = programs.size();
+      programs.push_back(std::move(pProgramBeingAssembled));
+      nodeLoad[*homeNode]++;
+    }
+    else
+    {
+      throw Error("Tried to add machine to node, but node is already full");
+    }
+
+    addressLookup.clear();
+  }
+}
+
+Instruction::Operand Script::regOrVal(const std::string& op)
+{
+  if (op == "x")
+  {
+    return Instruction::Register::X;
+  }
+
+  if (op == "t")
+  {
+    return Instruction::Register::T;
+  }
+
+  if (op == "m")
+  {
+    return Instruction::Register::M;
+  }
+
+  if (op == "f")
+  {
+    return Instruction::Register::F;
+  }
+
+  auto iter = hwRegMap.find(op);
+  if (iter != hwRegMap.end())
+  {
+    return iter->second;
+  }
+
+  Number val = std::stol(op);
+  return val;
+}
+
+Instruction::Operand Script::linkTarget(const std::string& op)
+{
+  Instruction::Operand ret = regOrVal(op);
+
+  if (std::holds_alternative<Number>(ret))
+  {
+    Number id = std::get<Number>(ret);
+
+    bool inRange = id >= std::numeric_limits<int16_t>::min() && id <= std::numeric_limits<int16_t>::max();
+
+    if (inRange && routeSlotCount < std::numeric_limits<uint16_t>::max())
+    {
+      ret = Instruction::Route{static_cast<int16_t>(id), routeSlot(static_cast<int16_t>(id))};
+    }
+  }
+
+  return ret;
+}
+
+uint16_t Script::routeSlot(int16_t id)
+{
+  uint16_t& rSlot = routeSlots[id - std::numeric_limits<int16_t>::min()];
+
+  if (rSlot == 0)
+  {
+    rSlot = routeSlotCount++;
+  }
+
+  return rSlot;
+}
+
+void Script::assignRouteSlots()
+{
+  // Literal link IDs in code always get a slot. Link IDs that are only reached
+  // through registers get one too, unless that would make the per-node tables
+  // too large, in which case they fall back to Node::link().
+  static constexpr size_t maxRouteEntries = 1 << 20;
+
+  for (const auto& rLink : links)
+  {
+    bool hasSlot = routeSlots[rLink.id - std::numeric_limits<int16_t>::min()] != 0;
+
+    if (!hasSlot && routeSlotCount < std::numeric_limits<uint16_t>::max() && nodes.size() * (routeSlotCount + 1) <= maxRouteEntries)
+    {
+      routeSlot(rLink.id);
+    }
+  }
+}
+
+void Script::clampSwizMasks()
+{
+  for (auto& rpProgram : programs)
+  {
+    for (auto& rInst : rpProgram->code)
+    {
+      if (auto* pMask = std::get_if<Instruction::SwizMask>(&rInst.op2))
+      {
+        Number written = pMask->mask;
+        *pMask = compileSwizMask(std::clamp(written, rangeMin, rangeMax));
+        pMask->mask = written;
+      }
+    }
+  }
+}
+
+size_t Script::findNode(const std::string& name, const char* pError) const
+{
+  auto iter = std::find_if(nodes.begin(), nodes.end(), [&](const NodeSpec& rNode)
+    {
+      return rNode.name == name;
+    });
+
+  if (iter == nodes.end())
+  {
+    throw Error(pError);
+  }
+
+  return iter - nodes.begin();
+}
+
+Instruction::Operand Script::reg(const std::string& op)
+{
+  if (op == "x")
+  {
+    return Instruction::Register::X;
+  }
+
+  if (op == "t")
+  {
+    return Instruction::Register::T;
+  }
+
+  if (op == "m")
+  {
+    return Instruction::Register::M;
+  }
+
+  if (op == "f")
+  {
+    return Instruction::Register::F;
+  }
+
+  auto iter = hwRegMap.find(op);
+  if (iter != hwRegMap.end())
+  {
+    return iter->second;
+  }
+
+  throw Error("Unrecognized register: " + op);
+}
+
+Instruction::Operand Script::bulkOperand(const std::string& mne, const std::string& op, bool allowNumber)
+{
+  if (!bulk)
+  {
+    throw Error("Bulk file instructions need .bulk: " + mne);
+  }
+
+  // They run over several cycles, so reading M or a hardware register would
+  // consume a value every cycle
+  if (op == "x" || op == "t")
+  {
+    return reg(op);
+  }
+
+  if (!allowNumber)
+  {
+    throw Error("Bulk file instructions only write to X or T: " + mne);
+  }
+
+  Instruction::Operand ret = regOrVal(op);
+  if (!std::holds_alternative<Number>(ret))
+  {
+    throw Error("Bulk file instructions only read X, T or a number: " + mne);
+  }
+
+  return ret;
+}
+
+Network::Network(const std::filesystem::path& path)
+  : Network(std::make_shared<const Script>(path))
+{
+  // Empty
+}
+
+Network::Network(std::shared_ptr<const Script> pScript, const NetworkOptions& options)
+  : pScript(std::move(pScript)),
+  options(options),
+  rangeMin(this->pScript->rangeMin),
+  rangeMax(this->pScript->rangeMax),
+  nextFileId(400),
+  nodes(),
+  activeNodes(),
+  arrivalNodes(),
+  globalChannels(this->pScript->channels.size()),
+  channelLookup(),
+  hwRegisters(),
+  swizMasks(),
+  machinePool(),
+  random(4604955068226825093l),
+  stats(),
+  instructionProfile(),
+  stallReason(StallReason::None),
+  pStallChannel(),
+  pStallNode(),
+  programStalls(this->pScript->programs.size(), StallCounts{}),
+  pTrace(),
+  traceSpawns(),
+  nextTraceSpawn(0),
+  pDumpWriter(),
+  pRecorder(),
+  pReplayer(),
+  discard(nullptr)
+{
+  const Script& rScript = *this->pScript;
+
+  if (!this->options.pLog)
+  {
+    this->options.pLog = &discard;
+  }
+
+  if (!this->options.pDump)
+  {
+    this->options.pDump = &discard;
+  }
+
+  if (options.seed)
+  {
+    random.seed(*options.seed);
+  }
+
+  swizMasks.fill(compileSwizMask(0));
+
+  stats.size = rScript.size;
+
+  nodes.resize(rScript.nodes.size());
+
+  for (size_t i = 0; i < nodes.size(); i++)
+  {
+    nodes[i].name = rScript.nodes[i].name;
+    nodes[i].capacity = rScript.nodes[i].capacity;
+  }
+
+  for (const auto& rLink : rScript.links)
+  {
+    nodes[rLink.from].addLink(rLink.id, nodes[rLink.to]);
+  }
+
+  for (const auto& rSpec : rScript.files)
+  {
+    File file = rSpec.file;
+    auto iter = options.files.find(file.id);
+
+    if (iter != options.files.end())
+    {
+      file.filename = std::filesystem::absolute(iter->second);
+      file.values.clear();
+      file.initFromDisk(rSpec.readBytes, rSpec.parseInts);
+    }
+
+    nodes[rSpec.node].addFile(std::move(file));
+  }
+
+  if (!options.recordPath.empty())
+  {
+    pRecorder = std::make_unique<InputRecorder>(options.recordPath);
+  }
+
+  if (!options.replayPath.empty())
+  {
+    pReplayer = std::make_unique<InputReplayer>(options.replayPath);
+  }
+
+  for (const auto& rpSpec : rScript.registers)
+  {
+    Node* pNode = &nodes[rpSpec->node];
+    std::unique_ptr<HwRegister> pRegister;
+    bool input = rpSpec->kind == "stdin" || rpSpec->kind == "rand" || rpSpec->kind == "file_in";
+
+    if (input && pReplayer)
+    {
+      pRegister = std::make_unique<ReplayRegister>(rpSpec->name, pNode, *pReplayer, static_cast<uint32_t>(rpSpec->index));
+    }
+    else if (rpSpec->kind == "sink")
+    {
+      pRegister = std::make_unique<HwRegister>(rpSpec->name, pNode);
+    }
+    else if (rpSpec->kind == "stdin")
+    {
+      pRegister = std::make_unique<StdinRegister>(rpSpec->name, pNode);
+    }
+    else if (rpSpec->kind == "stdout")
+    {
+      pRegister = std::make_unique<StdoutRegister>(rpSpec->name, pNode);
+    }
+    else if (rpSpec->kind == "stderr")
+    {
+      pRegister = std::make_unique<StderrRegister>(rpSpec->name, pNode);
+    }
+    else if (rpSpec->kind == "rand")
+    {
+      Number seed = std::stol(rpSpec->arg);
+
+      if (options.seed)
+      {
+        seed ^= static_cast<Number>(*options.seed * 0x9e3779b97f4a7c15ull);
+      }
+
+      pRegister = std::make_unique<RandRegister>(rpSpec->name, pNode, seed);
+    }
+    else if (rpSpec->kind == "file_in")
+    {
+      pRegister = std::make_unique<FileInRegister>(rpSpec->name, pNode, rpSpec->arg);
+    }
+    else if (rpSpec->kind == "file_out")
+    {
+      pRegister = std::make_unique<FileOutRegister>(rpSpec->name, pNode, rpSpec->arg);
+    }
+
+    if (input && pRecorder)
+    {
+      pRegister = std::make_unique<RecordingRegister>(std::move(pRegister), *pRecorder, static_cast<uint32_t>(rpSpec->index));
+    }
+
+    hwRegisters.push_back(pRegister.get());
+    pNode->registers[rpSpec->name] = std::move(pRegister);
+  }
+
+  for (size_t i = 0; i < rScript.channels.size(); i++)
+  {
+    channelLookup.emplace(rScript.channels[i].id, static_cast<uint16_t>(i));
+    globalChannels[i].depth = rScript.channels[i].depth;
+  }
+
+  for (const auto& rpProgram : rScript.programs)
+  {
+    Node& rHome = nodes[rpProgram->home];
+    rHome.machines.add(rpProgram.get(), machinePool.create(rpProgram.get()));
+    rHome.occupancy++;
+  }
+
+  buildRoutes();
+
+  if (!this->options.dumpPath.empty())
+  {
+    openDump(this->options.dumpPath);
+  }
+}
+
+RunStats Network::run(const RunOptions& runOptions)
+{
+  // Separate instantiations, so a run without profiling or tracing pays nothing for them
+  bool tracing = !runOptions.tracePath.empty();
+
+  if (runOptions.profile)
+  {
+    return tracing ? execute<true, true>(runOptions) : execute<true, false>(runOptions);
+  }
+
+  return tracing ? execute<false, true>(runOptions) : execute<false, false>(runOptions);
+}
+
+const Profile& Network::profile() const
+{
+  return instructionProfile;
+}
+
+const Script& Network::script() const
+{
+  return *pScript;
+}
+
+template <bool Profiling, bool Tracing>
+RunStats Network::execute(const RunOptions& runOptions)
+{
+  if (!runOptions.resumePath.empty())
+  {
+    loadCheckpoint(runOptions.resumePath);
+  }
+
+  // Time and memory are checked, and metrics published, after roughly this many machine steps
+  static constexpr size_t limitCheckWork = 1 << 16;
+
+  auto start = std::chrono::steady_clock::now();
+  size_t work = 0;
+  bool checkTime = runOptions.maxTime.count() > 0;
+  bool checkMemory = runOptions.maxMemory > 0;
+  bool trackMemory = runOptions.trackMemory;
+
+  stats.termination = RunStats::Termination::Completed;
+  stats.machineCycles = 0;
+  activeNodes.clear();
+
+  if (trackMemory)
+  {
+    stats.peakMemory = MemoryCounts{};
+    stats.peakMemoryBytes = 0;
+    sampleMemory();
+  }
+
+  if (runOptions.pMetrics)
+  {
+    runOptions.pMetrics->running.store(true, std::memory_order_relaxed);
+    publishMetrics(*runOptions.pMetrics);
+  }
+
+  if constexpr (Tracing)
+  {
+    std::vector<std::string> nodeNames;
+    for (const auto& rNode : nodes)
+    {
+      nodeNames.push_back(rNode.name);
+    }
+
+    std::vector<std::string> programNames;
+    for (const auto& rpProgram : pScript->programs)
+    {
+      programNames.push_back(rpProgram->name);
+    }
+
+    std::vector<int64_t> channelIds;
+    for (const auto& rSpec : pScript->channels)
+    {
+      channelIds.push_back(rSpec.id);
+    }
+
+    pTrace = std::make_unique<TraceWriter>(runOptions.tracePath, nodeNames, programNames, channelIds);
+    traceSpawns.assign(machinePool.records.size(), 0);
+    nextTraceSpawn = 0;
+
+    for (const auto& rNode : nodes)
+    {
+      for (size_t i = 0; i < rNode.machines.size(); i++)
+      {
+        traceSpawns[rNode.machines.id[i]] = nextTraceSpawn++;
+        trace(TraceEventType::Start, rNode.machines.id[i], rNode, static_cast<uint32_t>(rNode.machines.program[i]->index));
+      }
+    }
+  }
+
+  if constexpr (Profiling)
+  {
+    instructionProfile.counts.resize(pScript->programs.size());
+
+    for (const auto& rpProgram : pScript->programs)
+    {
+      instructionProfile.counts[rpProgram->index].resize(rpProgram->code.size());
+    }
+  }
+
+  for (auto& rNode : nodes)
+  {
+    rNode.active = !rNode.machines.empty();
+
+    if (rNode.active)
+    {
+      activeNodes.push_back(&rNode);
+    }
+  }
+
+  do
+  {
+    stats.cycles++;
+
+    for (Node* pNode : activeNodes)
+    {
+      Node& rNode = *pNode;
+      MachineTable& rMachines = rNode.machines;
+      bool anyKilled = false;
+      size_t index = 0;
+      size_t kept = 0; // Machines that stay are moved down to this slot
+
+      work += rMachines.size();
+      retiredSlots.clear();
+
+      while (index < rMachines.size())
+      {
+        // Killed by an earlier machine this cycle; it still runs its
+        // instruction and is retired afterwards
+        bool killed = rMachines.terminated[index];
+        bool advance = true;
+        bool departed = false;
+        const Program* pProgram = rMachines.program[index];
+        Instruction::Address address = rMachines.instPtr[index];
+
+        try
+        {
+          if (rMachines.sendingM[index])
+          {
+            // Finishes the instruction once this machine, at the head of
+            // the queue, finds room in the channel on its own turn
+            Channel* pChannel = machinePool[rMachines.id[index]].pSendChannel;
+
+            if (pChannel->deliver(rMachines.id[index], machinePool))
+            {
+              rMachines.sendingM[index] = false;
+              if constexpr (Tracing)
+              {
+                trace(TraceEventType::Send, rMachines.id[index], rNode, traceChannel(rNode, index), 2);
+              }
+            }
+            else
+            {
+              noteStall(StallReason::SendM, pChannel, &rNode);
+              advance = false;
+            }
+          }
+          else
+          {
+            if (rMachines.done(index))
+            {
+              throw MachineFailure("No more instructions");
+            }
+
+            const Instruction& inst = rMachines.program[index]->code[rMachines.instPtr[index]];
+
+            switch (inst.opcode)
+            {
+              case Instruction::Opcode::Copy:
+              {
+                std::optional<Value> val = get<Tracing>(rNode, index, inst.op1);
+                advance = val.has_value() && set<Tracing>(rNode, index, inst.op2, val.value());
+                break;
+              }
+              case Instruction::Opcode::Addi:
+              {
+                std::optional<Value> left = get<Tracing>(rNode, index, inst.op1);
+                std::optional<Value> right = get<Tracing>(rNode, index, inst.op2);
+                advance = left && right && set<Tracing>(rNode, index, inst.op3, *left + *right);
+                break;
+              }
+              case Instruction::Opcode::Subi:
+              {
+                std::optional<Value> left = get<Tracing>(rNode, index, inst.op1);
+                std::optional<Value> right = get<Tracing>(rNode, index, inst.op2);
+                advance = left && right && set<Tracing>(rNode, index, inst.op3, *left - *right);
+                break;
+              }
+              case Instruction::Opcode::Muli:
+              {
+                std::optional<Value> left = get<Tracing>(rNode, index, inst.op1);
+                std::optional<Value> right = get<Tracing>(rNode, index, inst.op2);
+                advance = left && right && set<Tracing>(rNode, index, inst.op3, *left * *right);
+                break;
+              }
+              case Instruction::Opcode::Divi:
+              {
+                std::optional<Value> left = get<Tracing>(rNode, index, inst.op1);
+                std::optional<Value> right = get<Tracing>(rNode, index, inst.op2);
+                advance = left && right && set<Tracing>(rNode, index, inst.op3, *left / *right);
+                break;
+              }
+              case Instruction::Opcode::Modi:
+              {
+                std::optional<Value> left = get<Tracing>(rNode, index, inst.op1);
+                std::optional<Value> right = get<Tracing>(rNode, index, inst.op2);
+                advance = left && right && set<Tracing>(rNode, index, inst.op3, *left % *right);
+                break;
+              }
+              case Instruction::Opcode::Swiz:
+              {
+                std::optional<Value> input = get<Tracing>(rNode, index, inst.op1);
+                const auto* pMask = std::get_if<Instruction::SwizMask>(&inst.op2);
+                std::optional<Value> mask = pMask ? std::nullopt : get<Tracing>(rNode, index, inst.op2);
+
+                if (input && (pMask || mask))
+                {
+                  if (!input->isNumber())
+                  {
+                    throw MachineFailure("Tried to swiz a string");
+                  }
+
+                  advance = set<Tracing>(rNode, index, inst.op3, swiz(input->number(), pMask ? *pMask : swizMask(*mask)));
+                }
+                else
+                {
+                  advance = false;
+                }
+
+                break;
+              }
+              case Instruction::Opcode::Jump:
+              {
+                if (std::holds_alternative<Instruction::Address>(inst.op1))
+                {
+                  rMachines.instPtr[index] = std::get<Instruction::Address>(inst.op1);
+                  advance = false;
+                }
+                else
+                {
+                  throw Error("Jump address is incorrect type");
+                }
 
                 break;
               }
@@ -806,9 +2506,9 @@ RunStats Network::run()
               {
                 if (std::holds_alternative<Instruction::Address>(inst.op1))
                 {
-                  if (std::holds_alternative<std::string>(rpMachine->t) || (std::holds_alternative<Number>(rpMachine->t) && std::get<Number>(rpMachine->t) != 0))
+                  if (rMachines.t[index].isString() || rMachines.t[index].number() != 0)
                   {
-                    rpMachine->instPtr = std::get<Instruction::Address>(inst.op1);
+                    rMachines.instPtr[index] = std::get<Instruction::Address>(inst.op1);
                     advance = false;
                   }
                 }
@@ -823,9 +2523,9 @@ RunStats Network::run()
               {
                 if (std::holds_alternative<Instruction::Address>(inst.op1))
                 {
-                  if (std::holds_alternative<Number>(rpMachine->t) && std::get<Number>(rpMachine->t) == 0)
+                  if (rMachines.t[index].isNumber() && rMachines.t[index].number() == 0)
                   {
-                    rpMachine->instPtr = std::get<Instruction::Address>(inst.op1);
+                    rMachines.instPtr[index] = std::get<Instruction::Address>(inst.op1);
                     advance = false;
                   }
                 }
@@ -847,14 +2547,14 @@ RunStats Network::run()
 
                 if (reg == Instruction::Register::M)
                 {
-                  Channel* pChannel = rpMachine->globalMode ? &globalChannel : &rNode.localChannel;
-                  rpMachine->t = pChannel->available() ? 1 : 0;
+                  Channel* pChannel = rMachines.globalMode[index] ? &globalChannels[rMachines.channel[index]] : &rNode.localChannel;
+                  rMachines.t[index] = pChannel->available() ? 1 : 0;
                 }
                 else if (reg == Instruction::Register::F)
                 {
-                  if (rpMachine->file.has_value())
+                  if (machinePool[rMachines.id[index]].file.has_value())
                   {
-                    rpMachine->t = rpMachine->file->eof() ? 1 : 0;
+                    rMachines.t[index] = machinePool[rMachines.id[index]].file->eof() ? 1 : 0;
                   }
                   else
                   {
@@ -870,12 +2570,12 @@ RunStats Network::run()
               }
               case Instruction::Opcode::TestEq:
               {
-                std::optional<Value> left = get(rNode, *rpMachine, inst.op1);
-                std::optional<Value> right = get(rNode, *rpMachine, inst.op2);
+                std::optional<Value> left = get<Tracing>(rNode, index, inst.op1);
+                std::optional<Value> right = get<Tracing>(rNode, index, inst.op2);
 
                 if (left && right)
                 {
-                  rpMachine->t = *left == *right ? 1 : 0;
+                  rMachines.t[index] = *left == *right ? 1 : 0;
                 }
                 else
                 {
@@ -886,12 +2586,12 @@ RunStats Network::run()
               }
               case Instruction::Opcode::TestGt:
               {
-                std::optional<Value> left = get(rNode, *rpMachine, inst.op1);
-                std::optional<Value> right = get(rNode, *rpMachine, inst.op2);
+                std::optional<Value> left = get<Tracing>(rNode, index, inst.op1);
+                std::optional<Value> right = get<Tracing>(rNode, index, inst.op2);
 
                 if (left && right)
                 {
-                  rpMachine->t = *left > *right ? 1 : 0;
+                  rMachines.t[index] = *left > *right ? 1 : 0;
                 }
                 else
                 {
@@ -902,12 +2602,12 @@ RunStats Network::run()
               }
               case Instruction::Opcode::TestLt:
               {
-                std::optional<Value> left = get(rNode, *rpMachine, inst.op1);
-                std::optional<Value> right = get(rNode, *rpMachine, inst.op2);
+                std::optional<Value> left = get<Tracing>(rNode, index, inst.op1);
+                std::optional<Value> right = get<Tracing>(rNode, index, inst.op2);
 
                 if (left && right)
                 {
-                  rpMachine->t = *left < *right ? 1 : 0;
+                  rMachines.t[index] = *left < *right ? 1 : 0;
                 }
                 else
                 {
@@ -924,26 +2624,35 @@ RunStats Network::run()
               {
                 stats.activity++;
 
-                if (rNode.machines.size() > 1)
+                if (rMachines.size() > 1)
                 {
-                  std::uniform_int_distribution<size_t> dist(0, rNode.machines.size() - 2);
-                  size_t target = dist(random);
+                  // Draw from the other slots the node started the cycle
+                  // with, then step over this one
+                  size_t target = pickRandom(rMachines.size() - 1);
+                  bool present = true;
 
-                  int curIdx = 0;
-                  for (auto& rpTarget : rNode.machines)
+                  if (target >= index)
                   {
-                    if (rpTarget == rpMachine)
-                    {
-                      curIdx--;
-                    }
+                    target++;
+                  }
+                  else
+                  {
+                    // Slots before this one have been compacted; a machine
+                    // that already left this cycle is not there to kill
+                    auto iter = std::lower_bound(retiredSlots.begin(), retiredSlots.end(), target);
+                    present = iter == retiredSlots.end() || *iter != target;
+                    target -= iter - retiredSlots.begin();
+                  }
 
-                    if (curIdx == target)
+                  if (present)
+                  {
+                    rMachines.terminated[target] = true;
+                    if constexpr (Tracing)
                     {
-                      rpTarget->terminated = true;
-                      break;
+                      trace(TraceEventType::Kill, rMachines.id[index], rNode, traceSpawns[rMachines.id[target]]);
                     }
 
-                    curIdx += 1;
+                    anyKilled = true;
                   }
                 }
 
@@ -951,48 +2660,94 @@ RunStats Network::run()
               }
               case Instruction::Opcode::Link:
               {
-                std::optional<Value> dest = get(rNode, *rpMachine, inst.op1);
+                Node* pTarget = nullptr;
 
-                if (dest)
+                if (std::holds_alternative<Instruction::Route>(inst.op1))
                 {
-                  if (!std::holds_alternative<Number>(*dest))
-                  {
-                    throw MachineFailure("Cannot link to a string");
-                  }
-
-                  auto iter = rNode.links.find(static_cast<uint16_t>(std::get<Number>(inst.op1)));
-
-                  if (iter == rNode.links.end())
-                  {
-                    throw MachineFailure("Link does not exist");
-                  }
+                  pTarget = rNode.routes[std::get<Instruction::Route>(inst.op1).slot];
+                }
+                else
+                {
+                  std::optional<Value> dest = get<Tracing>(rNode, index, inst.op1);
 
-                  if (iter->second.get().full())
+                  if (!dest)
                   {
                     advance = false;
+                    break;
                   }
-                  else
+
+                  if (!dest->isNumber())
                   {
-                    stats.activity++;
-                    rpMachine->instPtr++;
-                    iter->second.get().incomingMachines.emplace_back(std::move(rpMachine));
+                    throw MachineFailure("Cannot link to a string");
                   }
+
+                  pTarget = route(rNode, dest->number());
+                }
+
+                if (!pTarget)
+                {
+                  throw MachineFailure("Link does not exist");
+                }
+
+                if (pTarget->full())
+                {
+                  noteStall(StallReason::LinkFull, nullptr, pTarget);
+                  advance = false;
                 }
                 else
                 {
+                  stats.activity++;
+                  if constexpr (Tracing)
+                  {
+                    trace(TraceEventType::Link, rMachines.id[index], rNode, static_cast<uint32_t>(pTarget - nodes.data()));
+                  }
+
+                  rMachines.instPtr[index]++;
+                  rMachines.transfer(index, pTarget->incomingMachines);
+                  noteArrival(*pTarget);
+                  rNode.occupancy--;
+                  pTarget->occupancy++;
                   advance = false;
+                  departed = true;
                 }
 
                 break;
               }
               case Instruction::Opcode::Host:
               {
-                advance = set(rNode, *rpMachine, inst.op1, rNode.name);
+                advance = set<Tracing>(rNode, index, inst.op1, rNode.name);
                 break;
               }
               case Instruction::Opcode::Mode:
               {
-                rpMachine->globalMode = !rpMachine->globalMode;
+                rMachines.globalMode[index] = !rMachines.globalMode[index];
+                break;
+              }
+              case Instruction::Opcode::Chan:
+              {
+                std::optional<Value> channel = get<Tracing>(rNode, index, inst.op1);
+
+                if (channel)
+                {
+                  if (!channel->isNumber())
+                  {
+                    throw MachineFailure("Cannot select channel: channel is a string");
+                  }
+
+                  auto iter = channelLookup.find(channel->number());
+
+                  if (iter == channelLookup.end())
+                  {
+                    throw MachineFailure("Channel does not exist");
+                  }
+
+                  rMachines.channel[index] = iter->second;
+                }
+                else
+                {
+                  advance = false;
+                }
+
                 break;
               }
               case Instruction::Opcode::Void:
@@ -1006,15 +2761,15 @@ RunStats Network::run()
 
                 if (reg == Instruction::Register::M)
                 {
-                  std::optional<Value> discard = get(rNode, *rpMachine, inst.op1);
+                  std::optional<Value> discard = get<Tracing>(rNode, index, inst.op1);
                   advance = discard.has_value();
                 }
                 else if (reg == Instruction::Register::F)
                 {
                   // Voiding past EOF kills exa
-                  if (rpMachine->file.has_value())
+                  if (machinePool[rMachines.id[index]].file.has_value())
                   {
-                    rpMachine->file->voidCurrent();
+                    machinePool[rMachines.id[index]].file->voidCurrent();
                   }
                   else
                   {
@@ -1030,36 +2785,42 @@ RunStats Network::run()
               }
               case Instruction::Opcode::Make:
               {
-                if (rpMachine->file.has_value())
+                if (machinePool[rMachines.id[index]].file.has_value())
                 {
                   throw MachineFailure("Tried to make, but already holding file");
                 }
 
-                rpMachine->file = File();
-                rpMachine->file->id = nextFileId++;
-                rpMachine->file->filename = std::to_string(rpMachine->file->id) + ".txt";
+                machinePool[rMachines.id[index]].file = File();
+                machinePool[rMachines.id[index]].file->id = nextFileId++;
+                machinePool[rMachines.id[index]].file->filename = std::to_string(machinePool[rMachines.id[index]].file->id) + ".txt";
 
                 break;
               }
               case Instruction::Opcode::Grab:
               {
-                std::optional<Value> fileId = get(rNode, *rpMachine, inst.op1);
+                std::optional<Value> fileId = get<Tracing>(rNode, index, inst.op1);
 
                 if (fileId)
                 {
-                  if (std::holds_alternative<Number>(*fileId))
+                  if (fileId->isNumber())
                   {
-                    auto iter = rNode.files.find(static_cast<uint16_t>(std::get<Number>(fileId.value())));
+                    auto iter = rNode.files.find(static_cast<uint16_t>(fileId->number()));
 
                     if (iter == rNode.files.end())
                     {
                       throw MachineFailure("Tried to grab nonexistent file");
                     }
 
-                    rpMachine->file.emplace(std::move(iter->second));
-                    rpMachine->file->offset = 0;
+                    if constexpr (Tracing)
+                    {
+                      trace(TraceEventType::Grab, rMachines.id[index], rNode, iter->first);
+                    }
+
+                    machinePool[rMachines.id[index]].file.emplace(std::move(iter->second));
+                    machinePool[rMachines.id[index]].file->offset = 0;
 
                     rNode.files.erase(iter);
+                    rNode.occupancy--;
                   }
                   else
                   {
@@ -1075,9 +2836,9 @@ RunStats Network::run()
               }
               case Instruction::Opcode::File:
               {
-                if (rpMachine->file)
+                if (machinePool[rMachines.id[index]].file)
                 {
-                  advance = set(rNode, *rpMachine, inst.op1, rpMachine->file->id);
+                  advance = set<Tracing>(rNode, index, inst.op1, machinePool[rMachines.id[index]].file->id);
                 }
                 else
                 {
@@ -1088,26 +2849,26 @@ RunStats Network::run()
               }
               case Instruction::Opcode::Seek:
               {
-                if (rpMachine->file)
+                if (machinePool[rMachines.id[index]].file)
                 {
-                  std::optional<Value> offset = get(rNode, *rpMachine, inst.op1);
+                  std::optional<Value> offset = get<Tracing>(rNode, index, inst.op1);
                   if (offset)
                   {
-                    if (std::holds_alternative<Number>(*offset))
+                    if (offset->isNumber())
                     {
-                      Number val = std::get<Number>(*offset);
-                      if (val < 0 && size_t(-val) > rpMachine->file->offset)
+                      Number val = offset->number();
+                      if (val < 0 && size_t(-val) > machinePool[rMachines.id[index]].file->offset)
                       {
-                        rpMachine->file->offset = 0;
+                        machinePool[rMachines.id[index]].file->offset = 0;
                       }
                       else
                       {
-                        rpMachine->file->offset += std::get<Number>(*offset);
+                        machinePool[rMachines.id[index]].file->offset += offset->number();
                       }
 
-                      if (rpMachine->file->offset > rpMachine->file->values.size())
+                      if (machinePool[rMachines.id[index]].file->offset > machinePool[rMachines.id[index]].file->values.size())
                       {
-                        rpMachine->file->offset = rpMachine->file->values.size();
+                        machinePool[rMachines.id[index]].file->offset = machinePool[rMachines.id[index]].file->values.size();
                       }
                     }
                     else
@@ -1129,16 +2890,21 @@ RunStats Network::run()
               }
               case Instruction::Opcode::Drop:
               {
-                if (rpMachine->file)
+                if (machinePool[rMachines.id[index]].file)
                 {
                   if (!rNode.full())
                   {
-                    uint16_t id = rpMachine->file->id;
-                    rNode.files.emplace(id, std::move(*rpMachine->file));
-                    rpMachine->file.reset();
+                    if constexpr (Tracing)
+                    {
+                      trace(TraceEventType::Drop, rMachines.id[index], rNode, machinePool[rMachines.id[index]].file->id);
+                    }
+
+                    rNode.addFile(std::move(*machinePool[rMachines.id[index]].file));
+                    machinePool[rMachines.id[index]].file.reset();
                   }
                   else
                   {
+                    noteStall(StallReason::NodeFull, nullptr, &rNode);
                     advance = false;
                   }
                 }
@@ -1151,9 +2917,9 @@ RunStats Network::run()
               }
               case Instruction::Opcode::Wipe:
               {
-                if (rpMachine->file)
+                if (machinePool[rMachines.id[index]].file)
                 {
-                  rpMachine->file->wipe();
+                  machinePool[rMachines.id[index]].file->wipe();
                 }
                 else
                 {
@@ -1169,10 +2935,10 @@ RunStats Network::run()
               }
               case Instruction::Opcode::Rand:
               {
-                uint64_t bits = random();
+                uint64_t bits = drawRandom();
                 int64_t val = 0;
                 std::memcpy(&val, &bits, sizeof(val));
-                advance = set(rNode, *rpMachine, inst.op1, val);
+                advance = set<Tracing>(rNode, index, inst.op1, val);
                 break;
               }
               case Instruction::Opcode::Repl:
@@ -1184,7 +2950,96 @@ RunStats Network::run()
 
                 if (!rNode.full())
                 {
-                  rNode.incomingMachines.emplace_back(rpMachine->repl(std::get<Instruction::Address>(inst.op1)));
+                  MachineId replica = machinePool.replicate(rMachines.id[index]);
+                  if constexpr (Tracing)
+                  {
+                    if (replica >= traceSpawns.size())
+                    {
+                      traceSpawns.resize(replica + 1);
+                    }
+
+                    traceSpawns[replica] = nextTraceSpawn++;
+                    trace(TraceEventType::Repl, rMachines.id[index], rNode, traceSpawns[replica], machinePool[replica].replIndex);
+                  }
+
+                  rMachines.repl(index, std::get<Instruction::Address>(inst.op1), replica, rNode.incomingMachines);
+                  noteArrival(rNode);
+                  rNode.occupancy++;
+                }
+                else
+                {
+                  noteStall(StallReason::NodeFull, nullptr, &rNode);
+                  advance = false;
+                }
+
+                break;
+              }
+              case Instruction::Opcode::Fsum:
+              case Instruction::Opcode::Fmin:
+              case Instruction::Opcode::Fmax:
+              case Instruction::Opcode::Fcnt:
+              {
+                std::optional<File>& rFile = machinePool[rMachines.id[index]].file;
+                if (!rFile)
+                {
+                  throw MachineFailure("Cannot scan file: no file held");
+                }
+
+                const Instruction::Operand& target = inst.opcode == Instruction::Opcode::Fcnt ? inst.op2 : inst.op1;
+                Value total = *get<Tracing>(rNode, index, target);
+
+                size_t end = std::min(rFile->offset + Instruction::bulkSlice, rFile->values.size());
+                const Value* pBegin = rFile->values.data() + rFile->offset;
+                const Value* pEnd = rFile->values.data() + end;
+
+                if (inst.opcode == Instruction::Opcode::Fcnt)
+                {
+                  total = total + Number(std::count(pBegin, pEnd, *get<Tracing>(rNode, index, inst.op1)));
+                }
+                else if (!total.isNumber() || anyString(pBegin, pEnd))
+                {
+                  throw MachineFailure("Tried to do arithmetic with a string");
+                }
+                else if (inst.opcode == Instruction::Opcode::Fsum)
+                {
+                  total = sumNumbers(pBegin, pEnd, total.number(), rangeMin, rangeMax);
+                }
+                else if (inst.opcode == Instruction::Opcode::Fmin)
+                {
+                  total = minNumber(pBegin, pEnd, total.number());
+                }
+                else
+                {
+                  total = maxNumber(pBegin, pEnd, total.number());
+                }
+
+                rFile->offset = end;
+                set<Tracing>(rNode, index, target, total);
+                advance = rFile->eof();
+                break;
+              }
+              case Instruction::Opcode::Ffnd:
+              {
+                std::optional<File>& rFile = machinePool[rMachines.id[index]].file;
+                if (!rFile)
+                {
+                  throw MachineFailure("Cannot search file: no file held");
+                }
+
+                size_t end = std::min(rFile->offset + Instruction::bulkSlice, rFile->values.size());
+                const Value* pBegin = rFile->values.data() + rFile->offset;
+                const Value* pEnd = rFile->values.data() + end;
+                const Value* pMatch = std::find(pBegin, pEnd, *get<Tracing>(rNode, index, inst.op1));
+
+                rFile->offset += pMatch - pBegin;
+
+                if (pMatch != pEnd)
+                {
+                  rMachines.t[index] = 1;
+                }
+                else if (rFile->eof())
+                {
+                  rMachines.t[index] = 0;
                 }
                 else
                 {
@@ -1193,9 +3048,32 @@ RunStats Network::run()
 
                 break;
               }
+              case Instruction::Opcode::Fill:
+              {
+                std::optional<File>& rFile = machinePool[rMachines.id[index]].file;
+                if (!rFile)
+                {
+                  throw MachineFailure("Cannot fill file: no file held");
+                }
+
+                size_t end = std::min(rFile->offset + Instruction::bulkSlice, rFile->values.size());
+                std::fill(rFile->values.begin() + rFile->offset, rFile->values.begin() + end, clamp(*get<Tracing>(rNode, index, inst.op1)));
+
+                rFile->offset = end;
+                advance = rFile->eof();
+                break;
+              }
               case Instruction::Opcode::Dump0:
               {
-                std::cout << *this << '\n';
+                if (pDumpWriter)
+                {
+                  writeDump(DumpRecord::Network, rNode, index);
+                }
+                else
+                {
+                  *options.pDump << *this << '\n';
+                }
+
                 break;
               }
               case Instruction::Opcode::Dump1:
@@ -1205,27 +3083,34 @@ RunStats Network::run()
                   throw Error("Dump did not have string param");
                 }
 
-                std::string s(std::get<std::string>(inst.op1));
+                const std::string& s = std::get<std::string>(inst.op1);
 
-                if (s == "me")
+                if (pDumpWriter && (s == "me" || s == "code"))
+                {
+                  writeDump(s == "me" ? DumpRecord::Machine : DumpRecord::Code, rNode, index);
+                }
+                else if (s == "me")
                 {
-                  std::cout << *rpMachine << '\n';
+                  rMachines.print(*options.pDump, index, machinePool);
+                  *options.pDump << '\n';
                 }
                 else if (s == "code")
                 {
-                  std::cout << "Code:[";
+                  *options.pDump << "Code:[";
+
+                  const std::vector<Instruction>& code = rMachines.program[index]->code;
 
-                  for (size_t i = 0; i < rpMachine->code.size(); i++)
+                  for (size_t i = 0; i < code.size(); i++)
                   {
-                    std::cout << rpMachine->code[i];
+                    *options.pDump << code[i];
 
-                    if (i < rpMachine->code.size() - 1)
+                    if (i < code.size() - 1)
                     {
-                      std::cout << "; ";
+                      *options.pDump << "; ";
                     }
                   }
 
-                  std::cout << "]\n";
+                  *options.pDump << "]\n";
                 }
                 else
                 {
@@ -1239,630 +3124,617 @@ RunStats Network::run()
         }
         catch (const MachineFailure& e)
         {
-          rpMachine->terminated = true;
-          std::cerr << rpMachine->name << ": " << e.what() << '\n';
+          rMachines.terminated[index] = true;
+          *options.pLog << machinePool.name(rMachines.id[index]) << ": " << e.what() << '\n';
         }
 
-        if (advance && rpMachine)
+        if (stallReason != StallReason::None)
         {
-          rpMachine->instPtr++;
+          if (!advance)
+          {
+            size_t reason = static_cast<size_t>(stallReason);
+            programStalls[pProgram->index][reason]++;
+
+            if (pStallNode)
+            {
+              pStallNode->stalls[reason]++;
+            }
+
+            if (pStallChannel)
+            {
+              (stallReason == StallReason::SendM ? pStallChannel->stats.sendStalls : pStallChannel->stats.receiveStalls)++;
+            }
+          }
+
+          stallReason = StallReason::None;
         }
-      }
 
-      for (auto& rpMachine : rNode.machines)
-      {
-        if (!rpMachine || !rpMachine->terminated)
+        if constexpr (Profiling)
         {
-          continue;
+          if (address < pProgram->code.size())
+          {
+            InstructionProfile& rCounts = instructionProfile.counts[pProgram->index][address];
+            Instruction::Opcode opcode = pProgram->code[address].opcode;
+            bool jumped = opcode == Instruction::Opcode::Jump || opcode == Instruction::Opcode::Tjmp || opcode == Instruction::Opcode::Fjmp;
+            bool bulk = opcode == Instruction::Opcode::Fsum || opcode == Instruction::Opcode::Fmin || opcode == Instruction::Opcode::Fmax ||
+              opcode == Instruction::Opcode::Fcnt || opcode == Instruction::Opcode::Ffnd || opcode == Instruction::Opcode::Fill;
+
+            // Jumps clear advance too, but they did finish; a bulk file
+            // instruction clears it until its last slice, but did its work
+            if (advance || departed || jumped || bulk || rMachines.terminated[index])
+            {
+              rCounts.executions++;
+            }
+            else
+            {
+              rCounts.blocked++;
+            }
+          }
         }
 
-        if (rpMachine->file)
+        if (departed)
         {
-          uint16_t id = rpMachine->file->id;
-          rNode.files.emplace(id, std::move(*rpMachine->file));
+          retiredSlots.push_back(index++);
+          continue;
         }
-      }
 
-      auto endIter = std::remove_if(rNode.machines.begin(), rNode.machines.end(),
-        [&](const std::unique_ptr<Machine>& pMachine)
+        if (rMachines.terminated[index])
         {
-          return !pMachine || pMachine->terminated;
-        });
-
-      rNode.machines.erase(endIter, rNode.machines.end());
-    }
-
-    for (auto& rNode : nodes)
-    {
-      for (auto& rpMachine : rNode.incomingMachines)
-      {
-        rNode.machines.push_back(std::move(rpMachine));
-      }
-
-      rNode.incomingMachines.clear();
-
-      machinesRemaining += rNode.machines.size();
-    }
-  } while (machinesRemaining > 0);
-
-  for (auto& rNode : nodes)
-  {
-    for (auto& rPair : rNode.files)
-    {
-      rPair.second.writeToDisk();
-    }
-  }
-
-  return stats;
-}
-
-std::ostream& operator<<(std::ostream& s, const Network& n)
-{
-  s << "TODO";
-
-  /*for (const auto& node : nodes)
-  {
-    s << node << '\n';
-  }
-
-  s << "  globalChannel: "*/
+          if constexpr (Tracing)
+          {
+            bool halted = address < pProgram->code.size() && pProgram->code[address].opcode == Instruction::Opcode::Halt;
+            TraceEndReason reason = killed ? TraceEndReason::Killed : halted ? TraceEndReason::Halt : TraceEndReason::Failure;
+            trace(TraceEventType::End, rMachines.id[index], rNode, static_cast<uint32_t>(reason));
+          }
 
-  return s;
-}
+          rNode.retireMachine(index, machinePool);
+          retiredSlots.push_back(index++);
+          continue;
+        }
 
-void Network::processConfigDirective(const std::string& line)
-{
-  static std::regex rangeStmt(R"r(\.range (-?\d+) (-?\d+))r", std::regex_constants::ECMAScript | std::regex_constants::icase);
-  static std::regex nodeStmt(R"r(\.node (\w+)(?: (\d+))?)r", std::regex_constants::ECMAScript | std::regex_constants::icase);
-  static std::regex linkStmt(R"r(\.link \((\w+) (-?\d+)\) \((\w+)(?: (-?\d+))?\))r", std::regex_constants::ECMAScript | std::regex_constants::icase);
-  static std::regex fileStmt(R"r(\.file "(.*)" (\w+) (\d+) (rw|ro) (word|byte) (noint|int)(?: (locked))?)r", std::regex_constants::ECMAScript | std::regex_constants::icase);
-  static std::regex regStmt(R"r(\.reg (sink|file_out|file_in|rand|stdin|stdout|stderr) (#[A-Z]+) (\w+)(?: "?(.*)"?)?)r", std::regex_constants::ECMAScript | std::regex_constants::icase);
-  static std::regex startStmt(R"r(\.start (\w+))r", std::regex_constants::ECMAScript | std::regex_constants::icase);
-  static std::regex homeStmt(R"r(\.home (\w+))r", std::regex_constants::ECMAScript | std::regex_constants::icase);
+        if (advance)
+        {
+          rMachines.instPtr[index]++;
+        }
 
-  std::smatch match;
+        if (kept != index)
+        {
+          rMachines.move(index, kept);
+        }
 
-  if (std::regex_match(line, match, rangeStmt))
-  {
-    rangeMin = std::stol(match[1]);
-    rangeMax = std::stol(match[2]);
-  }
-  else if (std::regex_match(line, match, nodeStmt))
-  {
-    Node node;
-    node.name = match[1];
+        kept++;
+        index++;
+      }
 
-    if (match[2].matched)
-    {
-      node.capacity = std::stoul(match[2]);
-    }
-    else
-    {
-      node.capacity = std::numeric_limits<size_t>::max();
-    }
+      // Machines killed after they already ran this cycle
+      if (anyKilled)
+      {
+        size_t live = kept;
+        kept = 0;
 
-    nodes.emplace_back(std::move(node));
-  }
-  else if (std::regex_match(line, match, linkStmt))
-  {
-    auto fromNode = std::find(nodes.begin(), nodes.end(), match[1].str());
+        for (index = 0; index < live; index++)
+        {
+          if (rMachines.terminated[index])
+          {
+            if constexpr (Tracing)
+            {
+              trace(TraceEventType::End, rMachines.id[index], rNode, static_cast<uint32_t>(TraceEndReason::Killed));
+            }
 
-    if (fromNode == nodes.end())
-    {
-      throw Error("Tried to link from unknown node");
-    }
+            rNode.retireMachine(index, machinePool);
+            continue;
+          }
 
-    auto toNode = std::find(nodes.begin(), nodes.end(), match[3].str());
+          if (kept != index)
+          {
+            rMachines.move(index, kept);
+          }
 
-    if (toNode == nodes.end())
-    {
-      throw Error("Tried to link to unknown node");
+          kept++;
+        }
+      }
+
+      rMachines.truncate(kept);
     }
 
-    int16_t fromNum = static_cast<int16_t>(std::stoi(match[2]));
+    bool joined = false;
 
-    bool inserted = fromNode->links.emplace(fromNum, *toNode).second;
-    if (!inserted)
+    for (Node* pNode : arrivalNodes)
     {
-      throw Error("Tried to replace existing link");
-    }
+      pNode->incomingMachines.transferAll(pNode->machines);
+      pNode->arriving = false;
 
-    if (match[4].matched)
-    {
-      int16_t toNum = static_cast<int16_t>(std::stoi(match[4]));
-      inserted = toNode->links.emplace(toNum, *fromNode).second;
-      if (!inserted)
+      if (!pNode->active)
       {
-        throw Error("Tried to replace existing link");
+        pNode->active = true;
+        activeNodes.push_back(pNode);
+        joined = true;
       }
     }
-  }
-  else if (std::regex_match(line, match, fileStmt))
-  {
-    File file;
 
-    auto node = std::find(nodes.begin(), nodes.end(), match[2].str());
+    arrivalNodes.clear();
 
-    if (node == nodes.end())
-    {
-      throw Error("Tried to add file to unknown node");
-    }
+    auto endIter = std::remove_if(activeNodes.begin(), activeNodes.end(),
+      [](Node* pNode)
+      {
+        if (pNode->machines.empty())
+        {
+          pNode->active = false;
+          return true;
+        }
 
-    file.filename = std::filesystem::absolute(match[1].str());
-    file.id = static_cast<uint16_t>(std::stoul(match[3]));
-    file.readonly = "ro" == match[4];
-    file.locked = match[7].matched;
+        return false;
+      });
 
-    file.initFromDisk("byte" == match[5], "int" == match[6]);
+    activeNodes.erase(endIter, activeNodes.end());
 
-    if (node->machines.size() + node->files.size() < node->capacity)
-    {
-      node->files.emplace(file.id, file);
-    }
-    else
-    {
-      throw Error("Tried to add file to node, but node is already full");
-    }
-  }
-  else if (std::regex_match(line, match, regStmt))
-  {
-    auto node = std::find(nodes.begin(), nodes.end(), match[3].str());
-    if (node == nodes.end())
+    if (joined)
     {
-      throw Error("Tried to add hardware register to unknown node");
+      // Nodes live in one vector, so address order is declaration order
+      std::sort(activeNodes.begin(), activeNodes.end());
     }
 
-    auto existingRegister = node->registers.find(match[2]);
-    if (existingRegister != node->registers.end())
+    if (activeNodes.empty())
     {
-      throw Error("Tried to add duplicate hardware register");
+      break;
     }
 
-    if (match[1] == "sink")
-    {
-      node->registers[match[2]] = std::make_unique<HwRegister>(match[2], &*node);
-    }
-    else if (match[1] == "stdin")
+    if (runOptions.checkpointInterval != 0 && stats.cycles % runOptions.checkpointInterval == 0)
     {
-      node->registers[match[2]] = std::make_unique<StdinRegister>(match[2], &*node);
+      saveCheckpoint(runOptions.checkpointPath);
     }
-    else if (match[1] == "stdout")
+
+    if (runOptions.maxCycles != 0 && stats.cycles >= runOptions.maxCycles)
     {
-      node->registers[match[2]] = std::make_unique<StdoutRegister>(match[2], &*node);
+      stats.termination = RunStats::Termination::CycleLimit;
     }
-    else if (match[1] == "stderr")
+    else if (runOptions.maxMachines != 0 && machinePool.live() > runOptions.maxMachines)
     {
-      node->registers[match[2]] = std::make_unique<StderrRegister>(match[2], &*node);
+      stats.termination = RunStats::Termination::MachineLimit;
     }
-    else if (match[1] == "rand")
+    else if (work >= limitCheckWork)
     {
-      if (!match[4].matched)
+      stats.machineCycles += work;
+      work = 0;
+
+      if (trackMemory)
       {
-        throw Error("Tried to create rand register without seed");
+        sampleMemory();
       }
 
-      node->registers[match[2]] = std::make_unique<RandRegister>(match[2], &*node, std::stol(match[4]));
-    }
-    else if (match[1] == "file_in")
-    {
-      if (!match[4].matched)
+      if (runOptions.pMetrics)
       {
-        throw Error("Tried to create file_in register without filename");
+        publishMetrics(*runOptions.pMetrics);
       }
 
-      node->registers[match[2]] = std::make_unique<FileInRegister>(match[2], &*node, match[4].str());
-    }
-    else if (match[1] == "file_out")
-    {
-      if (!match[4].matched)
+      if (checkTime && std::chrono::steady_clock::now() - start >= runOptions.maxTime)
       {
-        throw Error("Tried to create file_out register without filename");
+        stats.termination = RunStats::Termination::TimeLimit;
+      }
+      else if (checkMemory && memoryEstimate() > runOptions.maxMemory)
+      {
+        stats.termination = RunStats::Termination::MemoryLimit;
       }
-
-      node->registers[match[2]] = std::make_unique<FileOutRegister>(match[2], &*node, match[4].str());
-    }
-
-    std::string lower(match[2]);
-    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
-
-    hwRegMap.emplace(lower, node->registers[match[2]].get());
-  }
-  else if (std::regex_match(line, match, startStmt))
-  {
-    finalizeActiveMachine();
-    pMachineBeingAssembled = std::make_unique<Machine>();
-    pMachineBeingAssembled->name = match[1];
-  }
-  else if (std::regex_match(line, match, homeStmt))
-  {
-    auto node = std::find(nodes.begin(), nodes.end(), match[1].str());
-    if (node == nodes.end())
-    {
-      throw Error("Tried to set home to unrecognized node");
     }
+  } while (stats.termination == RunStats::Termination::Completed);
 
-    pHomeNode = &*node;
-  }
-  else
-  {
-    throw Error("Unrecognized config directive: " + line);
-  }
-}
+  stats.machineCycles += work;
+  stats.nodeMemory.clear();
 
-void Network::processPreprocessorDirective(const std::string& line)
-{
-  if (line.find("@rep") == 0)
-  {
-    repCount = std::stoul(line.data() + 5);
-    addRepLines = true;
-  }
-  else if (line.find("@end") == 0)
+  if (trackMemory)
   {
-    if (!addRepLines)
-    {
-      throw Error("Found @end without corresponding @rep");
-    }
-
-    addRepLines = false;
-
-    static std::regex incrementor(R"r((.*)@\{(-?\d+),(-?\d+)\}(.*))r");
+    MemoryReport report = sampleMemory();
 
-    for (size_t i = 0; i < repCount; i++)
+    for (size_t i = 0; i < nodes.size(); i++)
     {
-      for (const auto& line : repLines)
+      if (totalBytes(report.nodes[i]) > 0)
       {
-        std::smatch match;
-        if (std::regex_search(line, match, incrementor))
-        {
-          Number start = std::stol(match[2]);
-          Number inc = std::stol(match[3]);
-
-          std::ostringstream procLine;
-          procLine << match[1] << start + inc * i << match[4];
-
-          processInstruction(procLine.str());
-        }
-        else
-        {
-          processInstruction(line);
-        }
+        stats.nodeMemory.emplace_back(nodes[i].name, report.nodes[i]);
       }
     }
-
-    repLines.clear();
   }
-}
-
-void Network::processInstruction(const std::string& line)
-{
-  static std::regex noArgs(R"((halt|kill|mode|make|drop|wipe|noop|dump))");
-  static std::regex singleArg(R"((mark|repl|jump|tjmp|fjmp|test|link|host|void|grab|file|seek|rand|dump)\s+(\S+))");
-  static std::regex doubleArg(R"((copy)\s+(\S+)\s+(\S+))");
-  static std::regex tripleArg(R"((addi|subi|muli|divi|modi|swiz|test)\s+(\S+)\s+(\S+)\s+(\S+))");
-
-  std::smatch match;
 
-  if (std::regex_match(line, match, noArgs))
-  {
-    processNoArgs(match[1]);
-  }
-  else if (std::regex_match(line, match, singleArg))
-  {
-    processSingleArg(match[1], match[2]);
-  }
-  else if (std::regex_match(line, match, doubleArg))
-  {
-    processDoubleArg(match[1], match[2], match[3]);
-  }
-  else if (std::regex_match(line, match, tripleArg))
-  {
-    processTripleArg(match[1], match[2], match[3], match[4]);
-  }
-  else
+  if (runOptions.pMetrics)
   {
-    throw Error("Unrecognized or invalid instruction: " + line);
+    publishMetrics(*runOptions.pMetrics);
+    runOptions.pMetrics->running.store(false, std::memory_order_relaxed);
   }
-}
-
-void Network::processNoArgs(const std::string& mne)
-{
-  static std::map<std::string, Instruction::Opcode> opcodeMap = {
-    {"halt", Instruction::Opcode::Halt},
-    {"kill", Instruction::Opcode::Kill},
-    {"mode", Instruction::Opcode::Mode},
-    {"make", Instruction::Opcode::Make},
-    {"drop", Instruction::Opcode::Drop},
-    {"wipe", Instruction::Opcode::Wipe},
-    {"noop", Instruction::Opcode::Noop},
-    {"dump", Instruction::Opcode::Dump0}
-  };
 
-  auto iter = opcodeMap.find(mne);
-  if (iter == opcodeMap.end())
+  if (pTrace)
   {
-    throw Error("Unrecognized mnemonic: " + mne);
+    pTrace->record(TraceEventType::RunEnd, stats.cycles, 0, 0, 0);
+    pTrace->finish();
+    pTrace.reset();
   }
 
-  pMachineBeingAssembled->code.emplace_back(iter->second);
-}
-
-void Network::processSingleArg(const std::string& mne, const std::string& op1)
-{
-  if (mne == "mark")
-  {
-    addressLookup.emplace(op1, pMachineBeingAssembled->code.size());
-  }
-  else if (mne == "repl")
-  {
-    pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Repl, op1);
-  }
-  else if (mne == "jump")
-  {
-    pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Jump, op1);
-  }
-  else if (mne == "tjmp")
-  {
-    pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Tjmp, op1);
-  }
-  else if (mne == "fjmp")
-  {
-    pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Fjmp, op1);
-  }
-  else if (mne == "test")
-  {
-    if (op1 == "mrd")
-    {
-      pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Test1, Instruction::Register::M);
-    }
-    else if (op1 == "eof")
-    {
-      pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Test1, Instruction::Register::F);
-    }
-  }
-  else if (mne == "link")
-  {
-    pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Link, regOrVal(op1));
-  }
-  else if (mne == "host")
-  {
-    pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Host, reg(op1));
-  }
-  else if (mne == "void")
-  {
-    if (op1 == "m")
-    {
-      pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Void, Instruction::Register::M);
-    }
-    else if (op1 == "f")
-    {
-      pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Void, Instruction::Register::F);
-    }
-    else
-    {
-      throw Error("Void only accepts M or F");
-    }
-  }
-  else if (mne == "grab")
-  {
-    pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Grab, regOrVal(op1));
-  }
-  else if (mne == "file")
-  {
-    pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::File, reg(op1));
-  }
-  else if (mne == "seek")
-  {
-    pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Seek, regOrVal(op1));
-  }
-  else if (mne == "rand")
-  {
-    pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Rand, reg(op1));
-  }
-  else if (mne == "dump")
-  {
-    pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Dump1, op1);
-  }
-  else
+  if (pDumpWriter)
   {
-    throw Error("Unrecognized mnemonic: " + mne);
+    pDumpWriter->flush();
   }
-}
 
-void Network::processDoubleArg(const std::string& mne, const std::string& op1, const std::string& op2)
-{
-  if (mne == "copy")
+  if (pRecorder)
   {
-    pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Copy, regOrVal(op1), reg(op2));
-  }
-  else
-  {
-    throw Error("Unrecognized mnemonic: " + mne);
+    pRecorder->flush();
   }
 
-  int numM = 0;
-
-  numM += (std::holds_alternative<Instruction::Register>(pMachineBeingAssembled->code.back().op1) && std::get<Instruction::Register>(pMachineBeingAssembled->code.back().op1) == Instruction::Register::M) ? 1 : 0;
-  numM += (std::holds_alternative<Instruction::Register>(pMachineBeingAssembled->code.back().op2) && std::get<Instruction::Register>(pMachineBeingAssembled->code.back().op2) == Instruction::Register::M) ? 1 : 0;
-
-  if (numM > 1)
+  if (options.writeFiles)
   {
-    throw Error("Referenced M register too many times in one instruction");
-  }
-}
-
-void Network::processTripleArg(const std::string& mne, const std::string& op1, const std::string& op2, const std::string& op3)
-{
-  // addi|subi|muli|divi|modi|swiz|test
+    for (auto& rNode : nodes)
+    {
+      for (auto& rPair : rNode.files)
+      {
+        rPair.second.writeToDisk();
+      }
 
-  if (mne == "addi")
-  {
-    pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Addi, regOrVal(op1), regOrVal(op2), reg(op3));
-  }
-  else if (mne == "subi")
-  {
-    pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Subi, regOrVal(op1), regOrVal(op2), reg(op3));
-  }
-  else if (mne == "muli")
-  {
-    pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Muli, regOrVal(op1), regOrVal(op2), reg(op3));
+      // Only a run stopped by a limit ends with machines still holding files
+      for (MachineId id : rNode.machines.id)
+      {
+        if (machinePool[id].file)
+        {
+          machinePool[id].file->writeToDisk();
+        }
+      }
+    }
   }
-  else if (mne == "divi")
+
+  stats.channels.clear();
+
+  for (const auto& rPair : channelLookup)
   {
-    pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Divi, regOrVal(op1), regOrVal(op2), reg(op3));
+    const Channel& rChannel = globalChannels[rPair.second];
+
+    if (rChannel.stats.sends > 0 || rChannel.stats.receiveStalls > 0)
+    {
+      stats.channels.emplace_back(rPair.first == 0 ? std::string("global") : "global " + std::to_string(rPair.first), rChannel.stats);
+    }
   }
-  else if (mne == "modi")
+
+  for (const auto& rNode : nodes)
   {
-    pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Modi, regOrVal(op1), regOrVal(op2), reg(op3));
+    if (rNode.localChannel.stats.sends > 0 || rNode.localChannel.stats.receiveStalls > 0)
+    {
+      stats.channels.emplace_back(rNode.name, rNode.localChannel.stats);
+    }
   }
-  else if (mne == "swiz")
+
+  auto anyStalls = [](const StallCounts& counts)
+    {
+      return std::any_of(counts.begin(), counts.end(), [](uint64_t count) { return count > 0; });
+    };
+
+  stats.programStalls.clear();
+
+  for (const auto& rpProgram : pScript->programs)
   {
-    pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::Swiz, regOrVal(op1), regOrVal(op2), reg(op3));
+    if (anyStalls(programStalls[rpProgram->index]))
+    {
+      stats.programStalls.emplace_back(rpProgram->name, programStalls[rpProgram->index]);
+    }
   }
-  else if (mne == "test")
+
+  stats.nodeStalls.clear();
+
+  for (const auto& rNode : nodes)
   {
-    if (op2 == "<")
+    if (anyStalls(rNode.stalls))
     {
-      pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::TestLt, regOrVal(op1), regOrVal(op3));
+      stats.nodeStalls.emplace_back(rNode.name, rNode.stalls);
     }
-    else if (op2 == "=")
+  }
+
+  return stats;
+}
+
+size_t Network::memoryEstimate() const
+{
+  size_t ret = machinePool.capacity() * sizeof(MachineInfo);
+
+  auto fileBytes = [](const File& rFile)
     {
-      pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::TestEq, regOrVal(op1), regOrVal(op3));
-    }
-    else if (op2 == ">")
+      return sizeof(File) + rFile.values.capacity() * sizeof(Value);
+    };
+
+  auto channelBytes = [](const Channel& rChannel)
     {
-      pMachineBeingAssembled->code.emplace_back(Instruction::Opcode::TestGt, regOrVal(op1), regOrVal(op3));
-    }
-  }
-  else
+      return rChannel.buffer.capacity() * sizeof(Value) + rChannel.waiting.size() * sizeof(Channel::Sender);
+    };
+
+  for (const auto& rNode : nodes)
   {
-    throw Error("Unrecognized mnemonic: " + mne);
-  }
+    ret += (rNode.machines.size() + rNode.incomingMachines.size()) * MachineTable::rowBytes;
+    ret += channelBytes(rNode.localChannel);
 
-  int numM = 0;
+    for (const auto& rPair : rNode.files)
+    {
+      ret += fileBytes(rPair.second);
+    }
 
-  numM += (std::holds_alternative<Instruction::Register>(pMachineBeingAssembled->code.back().op1) && std::get<Instruction::Register>(pMachineBeingAssembled->code.back().op1) == Instruction::Register::M) ? 1 : 0;
-  numM += (std::holds_alternative<Instruction::Register>(pMachineBeingAssembled->code.back().op2) && std::get<Instruction::Register>(pMachineBeingAssembled->code.back().op2) == Instruction::Register::M) ? 1 : 0;
-  numM += (std::holds_alternative<Instruction::Register>(pMachineBeingAssembled->code.back().op3) && std::get<Instruction::Register>(pMachineBeingAssembled->code.back().op3) == Instruction::Register::M) ? 1 : 0;
+    for (MachineId id : rNode.machines.id)
+    {
+      if (machinePool[id].file)
+      {
+        ret += fileBytes(*machinePool[id].file);
+      }
+    }
+  }
 
-  if (numM > 1)
+  for (const auto& rChannel : globalChannels)
   {
-    throw Error("Referenced M register too many times in one instruction");
+    ret += channelBytes(rChannel);
   }
+
+  return ret;
 }
 
-void Network::finalizeActiveMachine()
+MemoryReport Network::memoryReport() const
 {
-  if (pMachineBeingAssembled)
-  {
-    if (addRepLines)
+  MemoryReport ret;
+  ret.nodes.resize(nodes.size());
+
+  auto add = [](MemoryCounts& rCounts, MemoryCategory category, size_t bytes, size_t blocks)
     {
-      throw Error("Missing @end after @rep");
-    }
+      rCounts[static_cast<size_t>(category)].bytes += bytes;
+      rCounts[static_cast<size_t>(category)].blocks += blocks;
+    };
 
-    if (!pHomeNode)
+  // Copies of a string share storage, which counts where it is first seen
+  std::unordered_set<const void*> seenStrings;
+
+  auto addString = [&](MemoryCounts& rCounts, const Value& val)
     {
-      throw Error("Tried to finalize machine before home node was set");
-    }
+      if (val.isString() && seenStrings.insert(val.storage()).second)
+      {
+        add(rCounts, MemoryCategory::Strings, val.storageBytes(), 1);
+      }
+    };
 
-    if (pHomeNode->machines.size() + pHomeNode->files.size() < pHomeNode->capacity)
+  auto addValues = [&](MemoryCounts& rCounts, MemoryCategory category, const std::vector<Value>& values)
     {
-      size_t curAddr = 0;
+      add(rCounts, category, values.capacity() * sizeof(Value), values.capacity() > 0);
 
-      for (auto& rInst : pMachineBeingAssembled->code)
+      for (const auto& rVal : values)
       {
-        if (rInst.opcode == Instruction::Opcode::Jump ||
-          rInst.opcode == Instruction::Opcode::Tjmp ||
-          rInst.opcode == Instruction::Opcode::Fjmp ||
-          rInst.opcode == Instruction::Opcode::Repl)
-        {
-          std::string label = std::get<std::string>(rInst.op1);
-          auto iter = addressLookup.find(label);
-          if (iter == addressLookup.end())
-          {
-            throw Error("Tried to jump/repl to unrecognized label: " + label);
-          }
+        addString(rCounts, rVal);
+      }
+    };
 
-          rInst.op1 = iter->second;
+  auto addFile = [&](MemoryCounts& rCounts, const File& rFile)
+    {
+      add(rCounts, MemoryCategory::Files, sizeof(File), 1);
+      addValues(rCounts, MemoryCategory::Files, rFile.values);
+    };
+
+  auto addChannel = [&](MemoryCounts& rCounts, const Channel& rChannel)
+    {
+      add(rCounts, MemoryCategory::Channels, rChannel.buffer.capacity() * sizeof(Value), rChannel.buffer.capacity() > 0);
+
+      // Slots outside the ring's live span hold values already received
+      for (size_t i = 0; i < rChannel.count; i++)
+      {
+        addString(rCounts, rChannel.buffer[(rChannel.head + i) % rChannel.depth]);
+      }
+
+      add(rCounts, MemoryCategory::Channels, rChannel.waiting.size() * sizeof(Channel::Sender), !rChannel.waiting.empty());
+
+      for (const auto& rSender : rChannel.waiting)
+      {
+        addString(rCounts, rSender.value);
+      }
+    };
+
+  auto addMachines = [&](MemoryCounts& rCounts, const MachineTable& rTable)
+    {
+      add(rCounts, MemoryCategory::Machines, rTable.instPtr.capacity() * MachineTable::rowBytes, rTable.instPtr.capacity() > 0 ? MachineTable::arrayCount : 0);
+
+      for (size_t i = 0; i < rTable.size(); i++)
+      {
+        const MachineInfo& rInfo = machinePool[rTable.id[i]];
+        add(rCounts, MemoryCategory::Machines, sizeof(MachineInfo), 0);
+        addString(rCounts, rTable.x[i]);
+        addString(rCounts, rTable.t[i]);
+
+        // The File itself is part of the record
+        if (rInfo.file)
+        {
+          addValues(rCounts, MemoryCategory::Files, rInfo.file->values);
         }
       }
+    };
+
+  for (size_t i = 0; i < nodes.size(); i++)
+  {
+    const Node& rNode = nodes[i];
+    MemoryCounts& rCounts = ret.nodes[i];
+
+    addMachines(rCounts, rNode.machines);
+    addMachines(rCounts, rNode.incomingMachines);
+    addChannel(rCounts, rNode.localChannel);
 
-      stats.size += pMachineBeingAssembled->code.size();
-      pHomeNode->machines.emplace_back(std::move(pMachineBeingAssembled));
+    for (const auto& rPair : rNode.files)
+    {
+      addFile(rCounts, rPair.second);
     }
-    else
+
+    for (size_t category = 0; category < memoryCategoryCount; category++)
     {
-      throw Error("Tried to add machine to node, but node is already full");
+      ret.total[category].bytes += rCounts[category].bytes;
+      ret.total[category].blocks += rCounts[category].blocks;
     }
+  }
 
-    addressLookup.clear();
+  for (const auto& rChannel : globalChannels)
+  {
+    addChannel(ret.total, rChannel);
+  }
+
+  // Records of live machines were counted with their nodes; the rest are
+  // either free or only kept for their names
+  size_t retained = machinePool.records.size() - machinePool.freeList.size() - machinePool.live();
+  add(ret.total, MemoryCategory::Machines, (machinePool.records.capacity() - machinePool.records.size() + machinePool.freeList.size()) * sizeof(MachineInfo), 1);
+  add(ret.total, MemoryCategory::Names, retained * sizeof(MachineInfo), 0);
+
+  for (const auto& rpProgram : pScript->programs)
+  {
+    add(ret.total, MemoryCategory::Code, rpProgram->code.capacity() * sizeof(Instruction) + rpProgram->source.capacity() * sizeof(SourceLine), 2);
   }
+
+  return ret;
 }
 
-Instruction::Operand Network::regOrVal(const std::string& op)
+std::ostream& operator<<(std::ostream& s, const Network& n)
 {
-  if (op == "x")
+  s << "TODO";
+
+  /*for (const auto& node : nodes)
   {
-    return Instruction::Register::X;
+    s << node << '\n';
   }
 
-  if (op == "t")
+  s << "  globalChannel: "*/
+
+  return s;
+}
+
+MemoryReport Network::sampleMemory()
+{
+  MemoryReport ret = memoryReport();
+
+  stats.memory = ret.total;
+  stats.peakMemoryBytes = std::max(stats.peakMemoryBytes, totalBytes(ret.total));
+
+  for (size_t category = 0; category < memoryCategoryCount; category++)
   {
-    return Instruction::Register::T;
+    stats.peakMemory[category].bytes = std::max(stats.peakMemory[category].bytes, ret.total[category].bytes);
+    stats.peakMemory[category].blocks = std::max(stats.peakMemory[category].blocks, ret.total[category].blocks);
   }
 
-  if (op == "m")
+  return ret;
+}
+
+void Network::publishMetrics(LiveMetrics& rMetrics) const
+{
+  uint64_t channelValues = 0;
+  uint64_t queuedSenders = 0;
+
+  for (const auto& rChannel : globalChannels)
   {
-    return Instruction::Register::M;
+    channelValues += rChannel.count;
+    queuedSenders += rChannel.waiting.size();
   }
 
-  if (op == "f")
+  for (const auto& rNode : nodes)
   {
-    return Instruction::Register::F;
+    channelValues += rNode.localChannel.count;
+    queuedSenders += rNode.localChannel.waiting.size();
   }
 
-  auto iter = hwRegMap.find(op);
-  if (iter != hwRegMap.end())
+  rMetrics.cycles.store(stats.cycles, std::memory_order_relaxed);
+  rMetrics.activity.store(stats.activity, std::memory_order_relaxed);
+  rMetrics.machines.store(machinePool.live(), std::memory_order_relaxed);
+  rMetrics.memoryBytes.store(memoryEstimate(), std::memory_order_relaxed);
+  rMetrics.channelValues.store(channelValues, std::memory_order_relaxed);
+  rMetrics.queuedSenders.store(queuedSenders, std::memory_order_relaxed);
+  rMetrics.peakMemoryBytes.store(stats.peakMemoryBytes, std::memory_order_relaxed);
+
+  for (size_t category = 0; category < memoryCategoryCount; category++)
   {
-    return iter->second;
+    rMetrics.categoryBytes[category].store(stats.memory[category].bytes, std::memory_order_relaxed);
+    rMetrics.categoryBlocks[category].store(stats.memory[category].blocks, std::memory_order_relaxed);
   }
+}
 
-  Number val = std::stol(op);
-  return val;
+void Network::buildRoutes()
+{
+  for (auto& rNode : nodes)
+  {
+    rNode.routes.assign(pScript->routeSlotCount, nullptr);
+
+    for (const auto& rLink : rNode.links)
+    {
+      uint16_t slot = pScript->routeSlots[rLink.first - std::numeric_limits<int16_t>::min()];
+
+      if (slot != 0)
+      {
+        rNode.routes[slot] = rLink.second;
+      }
+    }
+  }
 }
 
-Instruction::Operand Network::reg(const std::string& op)
+Node* Network::route(Node& rNode, Number id) const
 {
-  if (op == "x")
+  if (id < std::numeric_limits<int16_t>::min() || id > std::numeric_limits<int16_t>::max())
   {
-    return Instruction::Register::X;
+    return nullptr;
   }
 
-  if (op == "t")
+  uint16_t slot = pScript->routeSlots[id - std::numeric_limits<int16_t>::min()];
+
+  if (slot != 0)
   {
-    return Instruction::Register::T;
+    return rNode.routes[slot];
   }
 
-  if (op == "m")
+  return rNode.link(static_cast<int16_t>(id));
+}
+
+void Network::trace(TraceEventType type, MachineId machine, const Node& rNode, uint32_t arg, uint32_t extra)
+{
+  pTrace->record(type, stats.cycles, machine, traceSpawns[machine], static_cast<uint32_t>(&rNode - nodes.data()), arg, extra);
+}
+
+uint32_t Network::traceChannel(const Node& rNode, size_t machine) const
+{
+  if (rNode.machines.globalMode[machine])
   {
-    return Instruction::Register::M;
+    return rNode.machines.channel[machine];
   }
 
-  if (op == "f")
+  return static_cast<uint32_t>(globalChannels.size() + (&rNode - nodes.data()));
+}
+
+void Network::noteStall(StallReason reason, Channel* pChannel, Node* pNode)
+{
+  stallReason = reason;
+  pStallChannel = pChannel;
+  pStallNode = pNode;
+}
+
+void Network::noteArrival(Node& rNode)
+{
+  if (!rNode.arriving)
   {
-    return Instruction::Register::F;
+    rNode.arriving = true;
+    arrivalNodes.push_back(&rNode);
   }
+}
 
-  auto iter = hwRegMap.find(op);
-  if (iter != hwRegMap.end())
+template <bool Tracing>
+std::optional<Value> Network::get(Node& rNode, size_t machine, const Instruction::Operand& src)
+{
+  if (const auto* pRegister = std::get_if<Instruction::Register>(&src))
   {
-    return iter->second;
+    if (*pRegister == Instruction::Register::X)
+    {
+      return clamp(rNode.machines.x[machine]);
+    }
+    else if (*pRegister == Instruction::Register::T)
+    {
+      return clamp(rNode.machines.t[machine]);
+    }
+  }
+  else if (const auto* pNumber = std::get_if<Number>(&src))
+  {
+    return std::clamp(*pNumber, rangeMin, rangeMax);
   }
 
-  throw Error("Unrecognized register: " + op);
+  return getOther<Tracing>(rNode, machine, src);
 }
 
-std::optional<Value> Network::get(Node& rNode, Machine& rMachine, const Instruction::Operand& src)
+template <bool Tracing>
+std::optional<Value> Network::getOther(Node& rNode, size_t machine, const Instruction::Operand& src)
 {
+  MachineTable& rMachines = rNode.machines;
   std::optional<Value> ret;
 
   std::visit([&](const auto& arg)
@@ -1877,29 +3749,35 @@ std::optional<Value> Network::get(Node& rNode, Machine& rMachine, const Instruct
         switch (std::get<Instruction::Register>(src))
         {
           case Instruction::Register::X:
-            ret = rMachine.x;
+            ret = rMachines.x[machine];
             break;
           case Instruction::Register::T:
-            ret = rMachine.t;
+            ret = rMachines.t[machine];
             break;
           case Instruction::Register::M:
           {
-            if (rMachine.globalMode && globalChannel.available())
+            Channel& rChannel = rMachines.globalMode[machine] ? globalChannels[rMachines.channel[machine]] : rNode.localChannel;
+
+            if (rChannel.available())
             {
-              ret = globalChannel.receive();
+              ret = rChannel.receive();
+              if constexpr (Tracing)
+              {
+                trace(TraceEventType::Receive, rMachines.id[machine], rNode, traceChannel(rNode, machine));
+              }
             }
-            else if (!rMachine.globalMode && rNode.localChannel.available())
+            else
             {
-              ret = rNode.localChannel.receive();
+              noteStall(StallReason::ReceiveM, &rChannel, &rNode);
             }
 
             break;
           }
           case Instruction::Register::F:
           {
-            if (rMachine.file.has_value())
+            if (machinePool[rMachines.id[machine]].file.has_value())
             {
-              ret = rMachine.file->read();
+              ret = machinePool[rMachines.id[machine]].file->read();
             }
             else
             {
@@ -1914,15 +3792,25 @@ std::optional<Value> Network::get(Node& rNode, Machine& rMachine, const Instruct
       {
         ret = arg;
       }
+      else if constexpr (std::is_same_v<T, Instruction::Route>)
+      {
+        ret = Number(arg.id);
+      }
+      else if constexpr (std::is_same_v<T, Instruction::SwizMask>)
+      {
+        ret = arg.mask;
+      }
       else if constexpr (std::is_same_v<T, Instruction::Address>)
       {
         throw Error("Tried to read address as value");
       }
-      else if constexpr (std::is_same_v<T, HwRegister*>)
+      else if constexpr (std::is_same_v<T, const HwRegisterSpec*>)
       {
-        if (arg->pHost == &rNode)
+        HwRegister* pRegister = hwRegisters[arg->index];
+
+        if (pRegister->pHost == &rNode)
         {
-          ret = arg->read();
+          ret = pRegister->read();
         }
         else
         {
@@ -1939,8 +3827,30 @@ std::optional<Value> Network::get(Node& rNode, Machine& rMachine, const Instruct
   return ret;
 }
 
-bool Network::set(Node& rNode, Machine& rMachine, const Instruction::Operand& dest, const Value& val)
+template <bool Tracing>
+bool Network::set(Node& rNode, size_t machine, const Instruction::Operand& dest, const Value& val)
+{
+  if (const auto* pRegister = std::get_if<Instruction::Register>(&dest))
+  {
+    if (*pRegister == Instruction::Register::X)
+    {
+      rNode.machines.x[machine] = clamp(val);
+      return true;
+    }
+    else if (*pRegister == Instruction::Register::T)
+    {
+      rNode.machines.t[machine] = clamp(val);
+      return true;
+    }
+  }
+
+  return setOther<Tracing>(rNode, machine, dest, val);
+}
+
+template <bool Tracing>
+bool Network::setOther(Node& rNode, size_t machine, const Instruction::Operand& dest, const Value& val)
 {
+  MachineTable& rMachines = rNode.machines;
   Value clamped = clamp(val);
   bool ret = true;
 
@@ -1956,35 +3866,34 @@ bool Network::set(Node& rNode, Machine& rMachine, const Instruction::Operand& de
         switch (std::get<Instruction::Register>(dest))
         {
           case Instruction::Register::X:
-            rMachine.x = clamped;
+            rMachines.x[machine] = clamped;
             break;
           case Instruction::Register::T:
-            rMachine.t = clamped;
+            rMachines.t[machine] = clamped;
             break;
           case Instruction::Register::M:
           {
-            if (rMachine.globalMode)
+            Channel& rChannel = rMachines.globalMode[machine] ? globalChannels[rMachines.channel[machine]] : rNode.localChannel;
+
+            // Room freed by a receive is kept for senders already queued
+            if (rChannel.full() || !rChannel.waiting.empty())
             {
-              if (globalChannel.available())
-              {
-                ret = false;
-                rMachine.outM = val;
-              }
-              else
+              ret = false;
+              rChannel.enqueue(rMachines.id[machine], clamped, machinePool);
+              rMachines.sendingM[machine] = true;
+              if constexpr (Tracing)
               {
-                globalChannel.send(clamped);
+                trace(TraceEventType::Send, rMachines.id[machine], rNode, traceChannel(rNode, machine), 1);
               }
+
+              noteStall(StallReason::SendM, &rChannel, &rNode);
             }
             else
             {
-              if (rNode.localChannel.available())
+              rChannel.send(clamped);
+              if constexpr (Tracing)
               {
-                ret = false;
-                rMachine.outM = val;
-              }
-              else
-              {
-                rNode.localChannel.send(clamped);
+                trace(TraceEventType::Send, rMachines.id[machine], rNode, traceChannel(rNode, machine));
               }
             }
 
@@ -1992,9 +3901,9 @@ bool Network::set(Node& rNode, Machine& rMachine, const Instruction::Operand& de
           }
           case Instruction::Register::F:
           {
-            if (rMachine.file.has_value())
+            if (machinePool[rMachines.id[machine]].file.has_value())
             {
-              rMachine.file->write(clamped);
+              machinePool[rMachines.id[machine]].file->write(clamped);
             }
             else
             {
@@ -2005,7 +3914,7 @@ bool Network::set(Node& rNode, Machine& rMachine, const Instruction::Operand& de
           }
         }
       }
-      else if constexpr (std::is_same_v<T, Number>)
+      else if constexpr (std::is_same_v<T, Number> || std::is_same_v<T, Instruction::Route> || std::is_same_v<T, Instruction::SwizMask>)
       {
         throw Error("Tried to write to literal");
       }
@@ -2013,11 +3922,13 @@ bool Network::set(Node& rNode, Machine& rMachine, const Instruction::Operand& de
       {
         throw Error("Tried to write to code address");
       }
-      else if constexpr (std::is_same_v<T, HwRegister*>)
+      else if constexpr (std::is_same_v<T, const HwRegisterSpec*>)
       {
-        if (arg->pHost == &rNode)
+        HwRegister* pRegister = hwRegisters[arg->index];
+
+        if (pRegister->pHost == &rNode)
         {
-          arg->write(clamped);
+          pRegister->write(clamped);
         }
         else
         {
@@ -2029,11 +3940,51 @@ bool Network::set(Node& rNode, Machine& rMachine, const Instruction::Operand& de
   return ret;
 }
 
+uint64_t Network::drawRandom()
+{
+  if (pReplayer)
+  {
+    return pReplayer->draw();
+  }
+
+  uint64_t ret = random();
+  if (pRecorder)
+  {
+    pRecorder->draw(ret);
+  }
+
+  return ret;
+}
+
+size_t Network::pickRandom(size_t count)
+{
+  if (pReplayer)
+  {
+    size_t ret = pReplayer->pick();
+    if (ret >= count)
+    {
+      throw Error("Run diverged from input log: KILL target out of range");
+    }
+
+    return ret;
+  }
+
+  std::uniform_int_distribution<size_t> dist(0, count - 1);
+  size_t ret = dist(random);
+
+  if (pRecorder)
+  {
+    pRecorder->pick(ret);
+  }
+
+  return ret;
+}
+
 Value Network::clamp(const Value& val)
 {
-  if (std::holds_alternative<Number>(val))
+  if (val.isNumber())
   {
-    return std::clamp(std::get<Number>(val), rangeMin, rangeMax);
+    return std::clamp(val.number(), rangeMin, rangeMax);
   }
   else
   {
@@ -2041,52 +3992,56 @@ Value Network::clamp(const Value& val)
   }
 }
 
-Value Network::swiz(const Value& input, const Value& mask)
+const Instruction::SwizMask& Network::swizMask(const Value& mask)
 {
-  if (!std::holds_alternative<Number>(input))
+  if (!mask.isNumber())
   {
-    throw MachineFailure("Tried to swiz a string");
+    throw MachineFailure("Tried to use a string to swiz a number");
   }
 
-  if (!std::holds_alternative<Number>(mask))
+  Instruction::SwizMask& rEntry = swizMasks[static_cast<uint64_t>(mask.number()) % swizMasks.size()];
+
+  if (rEntry.mask != mask.number())
   {
-    throw MachineFailure("Tried to use a string to swiz a number");
+    rEntry = compileSwizMask(mask.number());
   }
 
-  Number output = 0;
-  std::string inStr = std::to_string(std::get<Number>(input));
-  std::string maskStr = std::to_string(std::get<Number>(mask));
+  return rEntry;
+}
 
-  bool negative = false;
+Value Network::swiz(Number input, const Instruction::SwizMask& mask)
+{
+  // Digits of the input, least significant first, as far as the mask looks.
+  // Past the last digit a negative input has its sign, which counts as the
+  // character '-' less '0'. Index 9 stays 0 for the mask's own zeros.
+  std::array<int8_t, 10> digits{};
+  uint64_t magnitude = input < 0 ? 0 - static_cast<uint64_t>(input) : static_cast<uint64_t>(input);
+  size_t count = 0;
 
-  for (signed char c : maskStr)
+  do
   {
-    if (c == '-')
-    {
-      negative = true;
-      continue;
-    }
+    digits[count++] = static_cast<int8_t>(magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0 && count < mask.digits);
 
-    output *= 10;
-
-    if (c == '0')
-    {
-      continue;
-    }
+  if (input < 0 && magnitude == 0 && count < mask.digits)
+  {
+    digits[count] = '-' - '0';
+  }
 
-    size_t dgt = c - '1';
+  // Unsigned so that masks of 19 digits wrap rather than overflow
+  uint64_t output = 0;
 
-    if (dgt < inStr.size())
-    {
-      output += inStr[inStr.size() - dgt - 1] - '0';
-    }
+  for (size_t i = 0; i < mask.length; i++)
+  {
+    output = output * 10 + static_cast<uint64_t>(static_cast<int64_t>(digits[mask.picks[i]]));
   }
 
-  if (negative)
+  if (mask.negative)
   {
-    output *= -1;
+    output = 0 - output;
   }
-  
-  return output;
+
+  return static_cast<Number>(output);
 }
 } // namespace ep
@@ -2,17 +2,28 @@
 #define EPP_HPP
 
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <functional>
-#include <list>
+#include <iostream>
 #include <map>
+#include <memory>
 #include <optional>
 #include <random>
+#include <set>
 #include <string>
 #include <variant>
 #include <vector>
 
+#include "dump.hpp"
+#include "memory.hpp"
+#include "metrics.hpp"
+#include "replay.hpp"
+#include "trace.hpp"
+
 namespace epp
 {
 struct Error : public std::runtime_error
@@ -26,7 +37,104 @@ struct MachineFailure : public Error
 };
 
 using Number = int64_t;
-using Value = std::variant<Number, std::string>;
+// A number or a string in one word, so moving values between registers,
+// channels and files is a plain copy. Numbers are stored shifted left with the
+// low bit clear, which limits them to 63 bits; constructing one saturates at
+// min and max. Strings are immutable and shared: the word points to counted
+// storage, with the low bit set, and copying one bumps the count.
+class Value
+{
+public:
+  static constexpr Number min = -(Number(1) << 62);
+  static constexpr Number max = (Number(1) << 62) - 1;
+
+  Value()
+    : word(0)
+  {
+    // Empty
+  }
+
+  Value(Number number)
+    : word(static_cast<uint64_t>(std::clamp(number, min, max)) << 1)
+  {
+    // Empty
+  }
+
+  Value(std::string string);
+
+  Value(const Value& other)
+    : word(other.word)
+  {
+    if (word & 1)
+    {
+      retain();
+    }
+  }
+
+  Value(Value&& other) noexcept
+    : word(other.word)
+  {
+    other.word = 0;
+  }
+
+  ~Value()
+  {
+    if (word & 1)
+    {
+      release();
+    }
+  }
+
+  Value& operator=(const Value& other)
+  {
+    Value copy(other);
+    std::swap(word, copy.word);
+    return *this;
+  }
+
+  Value& operator=(Value&& other) noexcept
+  {
+    std::swap(word, other.word);
+    return *this;
+  }
+
+  bool isNumber() const
+  {
+    return !(word & 1);
+  }
+
+  bool isString() const
+  {
+    return word & 1;
+  }
+
+  Number number() const // Only if isNumber()
+  {
+    return static_cast<Number>(word) >> 1;
+  }
+
+  const std::string& string() const; // Only if isString()
+
+  // The same for every copy of a string, and null for a number
+  const void* storage() const;
+
+  size_t storageBytes() const; // Heap bytes behind storage(), including the text
+
+  // Same representation; true for equal numbers and copies of one string
+  bool identical(const Value& other) const
+  {
+    return word == other.word;
+  }
+
+private:
+  struct Text;
+
+  void retain() const;
+
+  void release();
+
+  uint64_t word;
+};
 
 std::ostream& operator<<(std::ostream& rStream, const Value& val);
 
@@ -105,6 +213,41 @@ struct FileOutRegister : public HwRegister
   std::ofstream stream;
 };
 
+// Logs every value read from the register it wraps
+struct RecordingRegister : public HwRegister
+{
+  RecordingRegister(std::unique_ptr<HwRegister> pInner, InputRecorder& rRecorder, uint32_t index);
+
+  void write(const Value& val) override;
+
+  Value read() override;
+
+  std::unique_ptr<HwRegister> pInner;
+  InputRecorder& rRecorder;
+  uint32_t index;
+};
+
+// Stands in for an input register, returning what it read when recorded
+struct ReplayRegister : public HwRegister
+{
+  ReplayRegister(const std::string& name, Node* pNode, InputReplayer& rReplayer, uint32_t index);
+
+  Value read() override;
+
+  InputReplayer& rReplayer;
+  uint32_t index;
+};
+
+// A hardware register as declared by .reg; each Network creates its own
+struct HwRegisterSpec
+{
+  std::string name;
+  std::string kind;
+  std::string arg;
+  size_t node;
+  size_t index; // Into Network::hwRegisters
+};
+
 struct Instruction
 {
   enum class Opcode
@@ -138,6 +281,18 @@ struct Instruction
     Noop,
     Rand,
     Repl,
+    Chan,
+
+    // Bulk file instructions, only accepted after .bulk. Each takes one cycle
+    // per bulkSlice values from the file cursor, which it leaves after the
+    // last value it looked at, and finishes at the end of the file (FFND also
+    // finishes on a match). An empty range still takes one cycle.
+    Fsum,
+    Fmin,
+    Fmax,
+    Fcnt,
+    Ffnd,
+    Fill,
 
     Dump0,
     Dump1,
@@ -153,7 +308,27 @@ struct Instruction
 
   using Address = size_t;
 
-  using Operand = std::variant<std::monostate, Register, Number, Address, HwRegister*, std::string>;
+  // A literal link ID, along with the routing slot assigned to it at load time
+  struct Route
+  {
+    int16_t id;
+    uint16_t slot;
+  };
+
+  // A literal SWIZ mask, along with the input digit each output digit takes,
+  // worked out at load time
+  struct SwizMask
+  {
+    Number mask; // As written; the picks are for the mask clamped to .range
+    std::array<uint8_t, 20> picks; // Most significant output digit first; 0-8 pick a digit, 9 is a 0 in the mask
+    uint8_t length;
+    uint8_t digits; // Input digits to extract: one past the highest pick
+    bool negative;
+  };
+
+  using Operand = std::variant<std::monostate, Register, Number, Address, const HwRegisterSpec*, std::string, Route, SwizMask>;
+
+  static constexpr size_t bulkSlice = 64; // File values a bulk file instruction covers per cycle
 
   Instruction() = default;
   explicit Instruction(Opcode opcode, Operand op1 = Operand{}, Operand op2 = Operand{}, Operand op3 = Operand{});
@@ -168,7 +343,13 @@ std::ostream& operator<<(std::ostream& rStream, const Instruction& inst);
 
 std::ostream& operator<<(std::ostream& rStream, const Instruction::Register& reg);
 
-std::ostream& operator<<(std::ostream& rStream, const HwRegister* const hwreg);
+std::ostream& operator<<(std::ostream& rStream, const Instruction::Route& route);
+
+std::ostream& operator<<(std::ostream& rStream, const Instruction::SwizMask& mask);
+
+Instruction::SwizMask compileSwizMask(Number mask);
+
+std::ostream& operator<<(std::ostream& rStream, const HwRegisterSpec* const hwreg);
 
 std::ostream& operator<<(std::ostream& rStream, const Instruction::Operand& op);
 
@@ -198,35 +379,176 @@ struct File
   size_t offset = 0;
 };
 
-struct Machine
+// Where an instruction came from in the script
+struct SourceLine
 {
-  std::unique_ptr<Machine> repl(size_t address);
+  uint32_t line = 0;
+  uint32_t repLine = 0; // Line of the enclosing @rep, or 0
+  uint32_t repIteration = 0; // Which copy of the @rep body
+};
 
-  bool done() const;
+struct Program
+{
+  std::string name;
+  std::vector<Instruction> code;
+  std::vector<SourceLine> source; // Parallel to code
+  size_t home; // Node the machine starts in
+  size_t index; // Into Script::programs
+};
 
-  friend std::ostream& operator<<(std::ostream& s, const Machine& m);
+using MachineId = uint32_t;
 
-  std::string name;
-  Value x;
-  Value t;
-  std::optional<Value> outM;
+struct Channel;
+
+// Machine state that is not needed on every cycle
+struct MachineInfo
+{
   std::optional<File> file;
-  std::vector<Instruction> code;
-  size_t instPtr = 0;
-  size_t replCount = 0;
-  bool globalMode = true;
-  bool terminated = false;
+  const Program* pProgram = nullptr;
+  Channel* pSendChannel = nullptr; // Set while queued to send on M
+  MachineId parent = 0;
+  uint32_t replIndex = 0;
+  uint32_t replCount = 0;
+  uint32_t refs = 0; // The machine itself while it runs, plus each replica
+};
+
+// Recycles MachineInfo records so that REPL and termination don't allocate.
+// Names are only formatted when needed, from the chain of parent records, so a
+// record stays alive until its machine and all of its replicas have ended.
+class MachinePool
+{
+public:
+  static constexpr MachineId noParent = std::numeric_limits<MachineId>::max();
+
+  MachineId create(const Program* pProgram);
+
+  MachineId replicate(MachineId parent);
+
+  void release(MachineId id);
+
+  std::string name(MachineId id) const;
+
+  MachineInfo& operator[](MachineId id);
+
+  const MachineInfo& operator[](MachineId id) const;
+
+  size_t live() const; // Machines created or replicated and not yet released
+
+  size_t capacity() const; // Records, including ones only kept for names
+
+private:
+  friend class Network; // Checkpoints
+
+  MachineId allocate();
+
+  std::vector<MachineInfo> records;
+  std::vector<MachineId> freeList;
+  size_t liveCount = 0;
+};
+
+// Structure-of-arrays store for the machines in a node; index i of each array
+// describes the same machine. The execution pass compacts it in place, so
+// machines keep their declaration and arrival order.
+struct MachineTable
+{
+  size_t size() const;
+
+  bool empty() const;
+
+  bool done(size_t index) const;
+
+  void add(const Program* pProgram, MachineId machineId);
+
+  void repl(size_t index, Instruction::Address address, MachineId machineId, MachineTable& rDest);
+
+  // Leaves the slot to be dropped by compaction
+  void transfer(size_t index, MachineTable& rDest);
+
+  void transferAll(MachineTable& rDest);
+
+  void move(size_t from, size_t to);
+
+  void truncate(size_t count);
+
+  void print(std::ostream& s, size_t index, const MachinePool& pool) const;
+
+  std::vector<Instruction::Address> instPtr;
+  std::vector<const Program*> program;
+  std::vector<Value> x;
+  std::vector<Value> t;
+  std::vector<uint8_t> sendingM; // Queued on a channel; see MachineInfo::pSendChannel
+  std::vector<uint8_t> globalMode;
+  std::vector<uint16_t> channel; // Index into Network::globalChannels, used in global mode
+  std::vector<uint8_t> terminated;
+  std::vector<MachineId> id;
+
+  // Bytes one machine takes across the arrays above, and how many there are
+  static constexpr size_t rowBytes = sizeof(Instruction::Address) + sizeof(const Program*) + 2 * sizeof(Value) +
+    4 * sizeof(uint8_t) + sizeof(uint16_t) + sizeof(MachineId);
+  static constexpr size_t arrayCount = 9;
+};
+
+// Why a machine spent a cycle without finishing its instruction
+enum class StallReason : uint8_t
+{
+  SendM,
+  ReceiveM,
+  LinkFull, // Destination node full
+  NodeFull, // No room to DROP or REPL
+  None
+};
+
+constexpr size_t stallReasonCount = static_cast<size_t>(StallReason::None);
+
+using StallCounts = std::array<uint64_t, stallReasonCount>;
+
+const char* toString(StallReason reason);
+
+struct ChannelStats
+{
+  size_t sends = 0;
+  size_t receives = 0;
+  size_t queuedSends = 0; // Sends that had to wait: the channel was full or others were queued
+  size_t peakQueue = 0;
+  size_t sendStalls = 0; // Cycles machines spent waiting to send
+  size_t receiveStalls = 0; // Cycles machines spent waiting to receive
 };
 
+// A bounded FIFO for M, holding one value unless declared deeper. A sender
+// that finds it full, or finds others already queued, joins a FIFO queue. A
+// receive only frees a slot; the sender at the head of the queue puts its
+// value in on its own turn, so a channel never passes on more values per
+// cycle than it frees. Senders are served in the order they first blocked,
+// with ties broken by execution order within the cycle.
 struct Channel
 {
+  struct Sender
+  {
+    MachineId machine;
+    Value value;
+  };
+
+  bool full() const;
+
   bool send(const Value& value);
 
+  void enqueue(MachineId machine, const Value& value, MachinePool& rPool);
+
+  void cancel(MachineId machine);
+
   bool available() const;
 
+  // Sends the queued value if the machine heads the queue and there is room
+  bool deliver(MachineId machine, MachinePool& rPool);
+
   std::optional<Value> receive();
 
-  std::optional<Value> val;
+  std::vector<Value> buffer; // Ring of depth values, allocated on first send
+  size_t head = 0;
+  size_t count = 0;
+  size_t depth = 1;
+  std::deque<Sender> waiting;
+  ChannelStats stats;
 };
 
 struct Node
@@ -242,31 +564,132 @@ struct Node
 
   bool full() const;
 
+  Node* link(int16_t id) const;
+
+  bool addLink(int16_t id, Node& rTarget);
+
+  void addFile(File&& file);
+
+  // Releases the machine; the caller drops its slot from the table
+  void retireMachine(size_t index, MachinePool& rPool);
+
+  // Touched every cycle, so kept together at the front
+  MachineTable machines;
+  MachineTable incomingMachines;
+  size_t occupancy = 0; // Machines (including incoming) plus files
+  size_t capacity = std::numeric_limits<size_t>::max();
+  bool active = false; // In Network::activeNodes
+  bool arriving = false; // In Network::arrivalNodes
+  std::vector<std::pair<int16_t, Node*>> links; // Sorted by link ID
+  std::vector<Node*> routes; // Indexed by routing slot
+
   std::string name;
-  std::map<int16_t, std::reference_wrapper<Node>> links;
-  std::list<std::unique_ptr<Machine>> machines;
-  std::vector<std::unique_ptr<Machine>> incomingMachines;
   std::map<uint16_t, File> files;
   std::map<std::string, std::unique_ptr<HwRegister>> registers;
-  size_t capacity = std::numeric_limits<size_t>::max();
   Channel localChannel;
+
+  // Cycles lost waiting on this node: on M or for room to DROP/REPL by
+  // machines inside it, and to LINK in by machines outside it
+  StallCounts stalls{};
 };
 
 struct RunStats
 {
+  enum class Termination
+  {
+    Completed,
+    CycleLimit,
+    TimeLimit,
+    MachineLimit,
+    MemoryLimit
+  };
+
   size_t size;
   size_t cycles;
   size_t activity;
+  size_t machineCycles = 0; // Cycles summed over machines, blocked or not, in this call to run()
+  std::vector<std::pair<std::string, ChannelStats>> channels; // Channels that saw traffic
+  std::vector<std::pair<std::string, StallCounts>> programStalls; // By program, covering all replicas
+  std::vector<std::pair<std::string, StallCounts>> nodeStalls; // Nodes that stalled anything; see Node::stalls
+  Termination termination = Termination::Completed;
+
+  // Only filled in with RunOptions::trackMemory; see Network::memoryReport()
+  MemoryCounts memory{}; // When the run ended
+  MemoryCounts peakMemory{}; // Highest seen per category, not necessarily at the same time
+  uint64_t peakMemoryBytes = 0; // Highest total seen
+  std::vector<std::pair<std::string, MemoryCounts>> nodeMemory; // Nodes holding anything when the run ended
 };
 
-class Network
+struct InstructionProfile
+{
+  uint64_t executions = 0; // Cycles that completed the instruction
+  uint64_t blocked = 0; // Cycles spent waiting on it
+};
+
+// Filled in by Network::run() when RunOptions::profile is set
+struct Profile
+{
+  std::vector<std::vector<InstructionProfile>> counts; // Indexed by Program::index, then address
+};
+
+const char* toString(RunStats::Termination termination);
+
+// A parsed script. It is not modified after loading, so one Script can back
+// any number of Networks, including ones running on other threads.
+class Script
 {
 public:
-  Network(const std::filesystem::path& path);
+  struct NodeSpec
+  {
+    std::string name;
+    size_t capacity;
+  };
 
-  RunStats run();
+  struct LinkSpec
+  {
+    size_t from;
+    int16_t id;
+    size_t to;
+  };
 
-  friend std::ostream& operator<<(std::ostream& s, const Network& n);
+  struct FileSpec
+  {
+    File file; // Contents as read while loading
+    size_t node;
+    bool readBytes;
+    bool parseInts;
+  };
+
+  struct ChannelSpec
+  {
+    Number id;
+    size_t depth;
+  };
+
+  explicit Script(const std::filesystem::path& path);
+
+  Script(const Script&) = delete;
+  Script& operator=(const Script&) = delete;
+
+  std::filesystem::path path;
+  std::vector<std::string> sourceText; // Lines of the script as written
+
+  Number rangeMin;
+  Number rangeMax;
+  bool bulk; // .bulk enables the bulk file instructions
+
+  std::vector<NodeSpec> nodes;
+  std::vector<LinkSpec> links;
+  std::vector<FileSpec> files;
+  std::vector<std::unique_ptr<HwRegisterSpec>> registers;
+  std::vector<ChannelSpec> channels; // Default channel first
+  std::vector<std::unique_ptr<Program>> programs;
+
+  // Routing slots for link IDs, indexed by ID + 32768; 0 means no slot
+  std::vector<uint16_t> routeSlots;
+  uint16_t routeSlotCount;
+
+  size_t size;
 
 private:
   void processConfigDirective(const std::string& line);
@@ -285,17 +708,157 @@ private:
 
   void finalizeActiveMachine();
 
+  void assignRouteSlots();
+
+  void clampSwizMasks(); // Once .range is final, so SWIZ needn't clamp literal masks
+
+  size_t findNode(const std::string& name, const char* pError) const;
+
   Instruction::Operand regOrVal(const std::string& op);
 
+  Instruction::Operand linkTarget(const std::string& op);
+
+  uint16_t routeSlot(int16_t id);
+
   Instruction::Operand reg(const std::string& op);
 
-  std::optional<Value> get(Node& rNode, Machine& rMachine, const Instruction::Operand& src);
+  // X or T, or also a number if allowNumber is set
+  Instruction::Operand bulkOperand(const std::string& mne, const std::string& op, bool allowNumber);
+
+  std::optional<size_t> homeNode;
+  std::vector<size_t> nodeLoad; // Files and machines placed in each node so far
+  std::set<std::pair<size_t, int16_t>> linkKeys;
+  std::map<std::string, const HwRegisterSpec*> hwRegMap;
 
-  bool set(Node& rNode, Machine& rMachine, const Instruction::Operand& dest, const Value& val);
+  std::unique_ptr<Program> pProgramBeingAssembled;
+
+  std::map<std::string, Instruction::Address> addressLookup;
+
+  std::vector<std::pair<uint32_t, std::string>> repLines; // With their line numbers
+  bool addRepLines;
+  size_t repCount;
+  uint32_t repStartLine;
+  SourceLine currentSource;
+};
+
+struct NetworkOptions
+{
+  std::optional<uint64_t> seed; // Reseeds KILL, RAND and every rand register
+  std::map<uint16_t, std::filesystem::path> files; // Replacement contents for .file IDs
+  std::ostream* pLog = &std::cerr; // Machine failures; null discards them
+  std::ostream* pDump = &std::cout; // DUMP output; null discards it
+  std::filesystem::path dumpPath; // Binary DUMP records go here instead of pDump, if not empty; see dump.hpp
+  bool writeFiles = true; // Write files back to disk when the run ends
+
+  // Nondeterministic inputs are logged to recordPath, or fed back from
+  // replayPath instead of stdin, file_in, rand registers and KILL/RAND
+  // draws; see replay.hpp
+  std::filesystem::path recordPath;
+  std::filesystem::path replayPath;
+};
+
+struct RunOptions
+{
+  size_t checkpointInterval = 0; // Cycles between checkpoints; 0 disables them
+  std::filesystem::path checkpointPath;
+  std::filesystem::path resumePath; // Checkpoint to continue from, if not empty
+
+  // Limits stop the run cleanly between cycles; 0 means no limit. Time and
+  // memory are only checked every so often, so they can overshoot slightly.
+  size_t maxCycles = 0;
+  std::chrono::milliseconds maxTime{0};
+  size_t maxMachines = 0;
+  size_t maxMemory = 0; // Bytes, as estimated by Network::memoryEstimate()
+
+  bool profile = false; // Count cycles per instruction into Network::profile()
+
+  std::filesystem::path tracePath; // Binary event log to write, if not empty; see trace.hpp
+
+  LiveMetrics* pMetrics = nullptr; // Updated while the run goes on, if set
+
+  // Samples Network::memoryReport() into RunStats as the run goes on. Costs a
+  // walk over every value, so it is off unless asked for, even with pMetrics set.
+  bool trackMemory = false;
+};
+
+class Network
+{
+public:
+  explicit Network(const std::filesystem::path& path);
+
+  explicit Network(std::shared_ptr<const Script> pScript, const NetworkOptions& options = NetworkOptions());
+
+  RunStats run(const RunOptions& runOptions = RunOptions());
+
+  // Checkpoints can only be taken between cycles, and only restored into a
+  // Network built from the same script. A replaying Network continues its input
+  // log from where the checkpointed run was; a recording one cannot resume.
+  void saveCheckpoint(const std::filesystem::path& path) const;
+
+  void loadCheckpoint(const std::filesystem::path& path);
+
+  // Approximate bytes held by machines, files and channels
+  size_t memoryEstimate() const;
+
+  // Bytes and allocations by category and node; slower than memoryEstimate()
+  MemoryReport memoryReport() const;
+
+  const Profile& profile() const;
+
+  const Script& script() const;
+
+  friend std::ostream& operator<<(std::ostream& s, const Network& n);
+
+private:
+  template <bool Profiling, bool Tracing>
+  RunStats execute(const RunOptions& runOptions);
+
+  void buildRoutes();
+
+  Node* route(Node& rNode, Number id) const;
+
+  void noteArrival(Node& rNode);
+
+  void noteStall(StallReason reason, Channel* pChannel, Node* pNode);
+
+  void trace(TraceEventType type, MachineId machine, const Node& rNode, uint32_t arg = 0, uint32_t extra = 0);
+
+  uint32_t traceChannel(const Node& rNode, size_t machine) const;
+
+  MemoryReport sampleMemory(); // Also updates the memory figures in stats
+
+  void publishMetrics(LiveMetrics& rMetrics) const;
+
+  void openDump(const std::filesystem::path& path);
+
+  void writeDump(DumpRecord type, const Node& rNode, size_t machine);
+
+  // X, T and literals are handled inline; M, F and hardware registers go
+  // through getOther() and setOther()
+  template <bool Tracing>
+  std::optional<Value> get(Node& rNode, size_t machine, const Instruction::Operand& src);
+
+  template <bool Tracing>
+  std::optional<Value> getOther(Node& rNode, size_t machine, const Instruction::Operand& src);
+
+  template <bool Tracing>
+  bool set(Node& rNode, size_t machine, const Instruction::Operand& dest, const Value& val);
+
+  template <bool Tracing>
+  bool setOther(Node& rNode, size_t machine, const Instruction::Operand& dest, const Value& val);
 
   Value clamp(const Value& val);
 
-  static Value swiz(const Value& input, const Value& mask);
+  uint64_t drawRandom(); // For RAND
+
+  size_t pickRandom(size_t count); // For KILL, in [0, count)
+
+  const Instruction::SwizMask& swizMask(const Value& mask); // For masks not known at load time
+
+  static Value swiz(Number input, const Instruction::SwizMask& mask);
+
+  std::shared_ptr<const Script> pScript;
+  NetworkOptions options;
 
   Number rangeMin;
   Number rangeMax;
@@ -303,22 +866,42 @@ private:
   uint16_t nextFileId;
 
   std::vector<Node> nodes;
-  Channel globalChannel;
 
-  Node* pHomeNode;
-  std::map<std::string, HwRegister*> hwRegMap;
+  // Nodes holding machines, in declaration order, and nodes that were sent or
+  // replicated machines this cycle. Idle nodes appear in neither.
+  std::vector<Node*> activeNodes;
+  std::vector<Node*> arrivalNodes;
 
-  std::unique_ptr<Machine> pMachineBeingAssembled;
+  // Slots the current node's pass has dropped so far, in increasing order
+  std::vector<size_t> retiredSlots;
+  std::vector<Channel> globalChannels; // Default channel first, then any declared with .channel
+  std::map<Number, uint16_t> channelLookup;
 
-  std::map<std::string, Instruction::Address> addressLookup;
+  std::vector<HwRegister*> hwRegisters; // Indexed by HwRegisterSpec::index
 
-  std::vector<std::string> repLines;
-  bool addRepLines;
-  size_t repCount;
+  std::array<Instruction::SwizMask, 16> swizMasks; // Direct-mapped by mask value
+
+  MachinePool machinePool;
 
   std::mt19937_64 random;
 
   RunStats stats;
+  Profile instructionProfile;
+
+  // The reason the current instruction is waiting, if it is
+  StallReason stallReason;
+  Channel* pStallChannel;
+  Node* pStallNode;
+  std::vector<StallCounts> programStalls; // Indexed by Program::index
+
+  std::unique_ptr<TraceWriter> pTrace; // Only while run() is tracing
+  std::vector<uint32_t> traceSpawns; // Indexed by MachineId: the spawn its trace events carry
+  uint32_t nextTraceSpawn;
+  std::unique_ptr<DumpWriter> pDumpWriter; // Set if NetworkOptions::dumpPath is
+  std::unique_ptr<InputRecorder> pRecorder; // Set if NetworkOptions::recordPath is
+  std::unique_ptr<InputReplayer> pReplayer; // Set if NetworkOptions::replayPath is
+
+  std::ostream discard; // Stands in for a null log or dump stream
 };
 } // namespace epp
 
@@ -0,0 +1,465 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "batch.hpp"
+
+// Writes a synthetic .epp script, and the data files it refers to, for
+// stress testing the loader and run() at sizes the examples never reach.
+// Every node gets outgoing links 800 and up, the same number everywhere, so
+// generated code can hop without knowing where it is; where the topology has
+// no neighbour in some direction, that link leads back to the node itself.
+namespace
+{
+enum class Topology
+{
+  Grid,
+  Tree,
+  Ring,
+  Random
+};
+
+struct Options
+{
+  Topology topology = Topology::Grid;
+  size_t nodes = 100;
+  size_t capacity = 0; // 0 leaves nodes unlimited
+  size_t degree = 0; // Children per node for tree, links per node for random; 0 picks a default
+  size_t starts = 10;
+  size_t fanout = 2;
+  size_t depth = 3;
+  size_t hops = 8;
+  size_t exchanges = 4;
+  size_t burst = 1;
+  double globalRatio = 0.5;
+  size_t files = 0;
+  size_t fileSize = 100;
+  uint64_t seed = 1;
+  std::filesystem::path output;
+};
+
+constexpr int firstLink = 800;
+constexpr size_t firstFileId = 1000;
+
+std::string nodeName(size_t node)
+{
+  return "N" + std::to_string(node);
+}
+
+// Outgoing links of every node, in link id order
+std::vector<std::vector<size_t>> buildLinks(const Options& options, std::mt19937_64& rGen)
+{
+  size_t count = options.nodes;
+  std::vector<std::vector<size_t>> ret(count);
+
+  switch (options.topology)
+  {
+    case Topology::Grid:
+    {
+      size_t width = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+
+      for (size_t node = 0; node < count; node++)
+      {
+        size_t column = node % width;
+
+        ret[node].push_back(column + 1 < width && node + 1 < count ? node + 1 : node);
+        ret[node].push_back(column > 0 ? node - 1 : node);
+        ret[node].push_back(node >= width ? node - width : node);
+        ret[node].push_back(node + width < count ? node + width : node);
+      }
+
+      break;
+    }
+    case Topology::Tree:
+    {
+      size_t children = options.degree > 0 ? options.degree : 2;
+
+      for (size_t node = 0; node < count; node++)
+      {
+        ret[node].push_back(node > 0 ? (node - 1) / children : node);
+
+        for (size_t child = node * children + 1; child <= node * children + children; child++)
+        {
+          ret[node].push_back(child < count ? child : node);
+        }
+      }
+
+      break;
+    }
+    case Topology::Ring:
+      for (size_t node = 0; node < count; node++)
+      {
+        ret[node].push_back((node + 1) % count);
+        ret[node].push_back((node + count - 1) % count);
+      }
+
+      break;
+    case Topology::Random:
+    {
+      size_t degree = options.degree > 0 ? options.degree : 3;
+      std::uniform_int_distribution<size_t> pick(0, count - 1);
+
+      for (size_t node = 0; node < count; node++)
+      {
+        for (size_t link = 0; link < degree; link++)
+        {
+          size_t target = pick(rGen);
+          if (count > 1)
+          {
+            while (target == node)
+            {
+              target = pick(rGen);
+            }
+          }
+
+          ret[node].push_back(target);
+        }
+      }
+
+      break;
+    }
+  }
+
+  return ret;
+}
+
+void writeDataFile(const std::filesystem::path& path, size_t size, std::mt19937_64& rGen)
+{
+  std::ofstream out(path);
+  if (!out)
+  {
+    throw std::runtime_error("Could not write " + path.string());
+  }
+
+  std::uniform_int_distribution<int> value(-9999, 9999);
+
+  for (size_t i = 0; i < size; i++)
+  {
+    out << value(rGen) << (i % 16 == 15 ? '\n' : ' ');
+  }
+
+  out << '\n';
+}
+
+// One .start program. It reads its file if it has one, replicates into a tree
+// of `depth` levels with `fanout` children per machine, then every copy walks
+// a fixed random path and does its exchanges. Each exchange replicates a sink
+// for the values it sends, so sends and receives always balance: a local sink
+// stays in the sender's node, a global sink hops away first.
+void writeProgram(std::ostream& rOut, const Options& options, size_t program, size_t home, const std::vector<size_t>& files,
+  size_t linkCount, std::mt19937_64& rGen)
+{
+  std::uniform_int_distribution<size_t> pickLink(0, linkCount - 1);
+  std::uniform_int_distribution<int> value(-9999, 9999);
+  std::bernoulli_distribution global(options.globalRatio);
+
+  // The loader places a program when the next one starts, at whatever .home
+  // says then, so each program sets its home after its own .start
+  rOut << "\n.start P" << program << '\n';
+  rOut << ".home " << nodeName(home) << '\n';
+
+  if (program < files.size())
+  {
+    rOut << "grab " << firstFileId + program << '\n';
+    rOut << "mark read\n";
+    rOut << "test eof\n";
+    rOut << "tjmp readdone\n";
+    rOut << "copy f t\n";
+    rOut << "jump read\n";
+    rOut << "mark readdone\n";
+    rOut << "drop\n";
+  }
+
+  if (options.depth > 0 && options.fanout > 0)
+  {
+    rOut << "copy " << options.depth << " x\n";
+    rOut << "mark fan\n";
+    rOut << "test x > 0\n";
+    rOut << "fjmp work\n";
+    rOut << "subi x 1 x\n";
+
+    for (size_t i = 0; i < options.fanout; i++)
+    {
+      rOut << "repl fan\n";
+    }
+
+    rOut << "mark work\n";
+  }
+
+  bool globalMode = true;
+
+  for (size_t step = 0; step < std::max(options.hops, options.exchanges); step++)
+  {
+    if (step < options.hops)
+    {
+      rOut << "link " << firstLink + static_cast<int>(pickLink(rGen)) << '\n';
+    }
+
+    if (step < options.exchanges)
+    {
+      bool wantGlobal = global(rGen);
+      if (wantGlobal != globalMode)
+      {
+        rOut << "mode\n";
+        globalMode = wantGlobal;
+      }
+
+      rOut << (globalMode ? "repl gsink\n" : "repl lsink\n");
+
+      for (size_t i = 0; i < options.burst; i++)
+      {
+        rOut << "copy " << value(rGen) << " m\n";
+      }
+    }
+  }
+
+  rOut << "halt\n";
+
+  if (options.exchanges > 0)
+  {
+    rOut << "mark gsink\n";
+    rOut << "link " << firstLink << '\n';
+    rOut << "mark lsink\n";
+
+    for (size_t i = 0; i < options.burst; i++)
+    {
+      rOut << "copy m t\n";
+    }
+
+    rOut << "halt\n";
+  }
+}
+
+void generate(const Options& options)
+{
+  std::mt19937_64 gen(options.seed);
+
+  std::ofstream out(options.output);
+  if (!out)
+  {
+    throw std::runtime_error("Could not write " + options.output.string());
+  }
+
+  auto links = buildLinks(options, gen);
+  std::uniform_int_distribution<size_t> pickNode(0, options.nodes - 1);
+
+  out << "; Generated by epp-gen with seed " << options.seed << '\n';
+  out << ".range -9999 9999\n";
+
+  for (size_t node = 0; node < options.nodes; node++)
+  {
+    out << ".node " << nodeName(node);
+    if (options.capacity > 0)
+    {
+      out << ' ' << options.capacity;
+    }
+
+    out << '\n';
+  }
+
+  for (size_t node = 0; node < options.nodes; node++)
+  {
+    for (size_t link = 0; link < links[node].size(); link++)
+    {
+      out << ".link (" << nodeName(node) << ' ' << firstLink + static_cast<int>(link) << ") (" << nodeName(links[node][link]) << ")\n";
+    }
+  }
+
+  // Files are named relative to the script, so run it from its own directory
+  std::vector<size_t> fileNodes;
+  std::string stem = options.output.stem().string();
+
+  for (size_t file = 0; file < options.files; file++)
+  {
+    std::string filename = stem + "-" + std::to_string(file) + ".txt";
+    writeDataFile(options.output.parent_path() / filename, options.fileSize, gen);
+
+    fileNodes.push_back(pickNode(gen));
+    out << ".file \"" << filename << "\" " << nodeName(fileNodes.back()) << ' ' << firstFileId + file << " ro word int\n";
+  }
+
+  for (size_t program = 0; program < options.starts; program++)
+  {
+    // A program that reads a file starts where the file is
+    size_t home = program < fileNodes.size() ? fileNodes[program] : pickNode(gen);
+    writeProgram(out, options, program, home, fileNodes, links[0].size(), gen);
+  }
+
+  // Each program grows a tree of 1 + F + ... + F^depth machines, and each of
+  // those replicates one sink per exchange
+  uint64_t perStart = 0;
+  uint64_t level = 1;
+  for (size_t i = 0; i <= (options.fanout > 0 ? options.depth : 0); i++)
+  {
+    perStart += level;
+    level *= options.fanout;
+  }
+
+  std::cerr << options.nodes << " nodes, " << options.starts << " programs, " << options.starts * perStart << " EXAs plus "
+    << options.starts * perStart * options.exchanges << " sinks, " << options.files << " files\n";
+}
+
+void printUsage(const char* pProgram)
+{
+  std::cout << "Usage: " << pProgram << " [options] --output <script.epp>\n"
+    "Writes a synthetic workload script, and its data files next to it.\n"
+    "  --topology <t>      grid, tree, ring or random (default: grid)\n"
+    "  --nodes <n>         Node count (default: 100)\n"
+    "  --capacity <n>      Node capacity; 0 is unlimited (default: 0)\n"
+    "  --degree <n>        Children per tree node or links per random node (default: 2, 3)\n"
+    "  --starts <n>        .start programs, each with a random home (default: 10)\n"
+    "  --fanout <n>        Replicas each machine makes (default: 2)\n"
+    "  --depth <n>         Levels of replication (default: 3)\n"
+    "  --hops <n>          Links each machine follows (default: 8)\n"
+    "  --exchanges <n>     M exchanges per machine (default: 4)\n"
+    "  --burst <n>         Values sent per exchange (default: 1)\n"
+    "  --global-ratio <f>  Fraction of exchanges in global mode (default: 0.5)\n"
+    "  --files <n>         Data files; the first programs read them (default: 0)\n"
+    "  --file-size <n>     Values per data file (default: 100)\n"
+    "  --seed <n>          Generator seed (default: 1)\n"
+    "Small capacities can leave machines waiting on each other forever.\n";
+}
+
+Topology parseTopology(const std::string& name)
+{
+  if (name == "grid")
+  {
+    return Topology::Grid;
+  }
+  else if (name == "tree")
+  {
+    return Topology::Tree;
+  }
+  else if (name == "ring")
+  {
+    return Topology::Ring;
+  }
+  else if (name == "random")
+  {
+    return Topology::Random;
+  }
+
+  throw std::invalid_argument("Unknown topology: " + name);
+}
+} // namespace
+
+int main(int argc, char** pArgv)
+{
+  Options options;
+  std::vector<std::string> args(pArgv + 1, pArgv + argc);
+
+  try
+  {
+    for (size_t i = 0; i < args.size(); i++)
+    {
+      const std::string& rArg = args[i];
+
+      if (i + 1 >= args.size())
+      {
+        printUsage(pArgv[0]);
+        return 1;
+      }
+
+      const std::string& rValue = args[++i];
+
+      if (rArg == "--topology")
+      {
+        options.topology = parseTopology(rValue);
+      }
+      else if (rArg == "--nodes")
+      {
+        options.nodes = epp::parseCount(rValue);
+      }
+      else if (rArg == "--capacity")
+      {
+        options.capacity = epp::parseCount(rValue);
+      }
+      else if (rArg == "--degree")
+      {
+        options.degree = epp::parseCount(rValue);
+      }
+      else if (rArg == "--starts")
+      {
+        options.starts = epp::parseCount(rValue);
+      }
+      else if (rArg == "--fanout")
+      {
+        options.fanout = epp::parseCount(rValue);
+      }
+      else if (rArg == "--depth")
+      {
+        options.depth = epp::parseCount(rValue);
+      }
+      else if (rArg == "--hops")
+      {
+        options.hops = epp::parseCount(rValue);
+      }
+      else if (rArg == "--exchanges")
+      {
+        options.exchanges = epp::parseCount(rValue);
+      }
+      else if (rArg == "--burst")
+      {
+        options.burst = epp::parseCount(rValue);
+      }
+      else if (rArg == "--global-ratio")
+      {
+        options.globalRatio = epp::parseFraction(rValue);
+      }
+      else if (rArg == "--files")
+      {
+        options.files = epp::parseCount(rValue);
+      }
+      else if (rArg == "--file-size")
+      {
+        options.fileSize = epp::parseCount(rValue);
+      }
+      else if (rArg == "--seed")
+      {
+        options.seed = epp::parseCount(rValue);
+      }
+      else if (rArg == "--output")
+      {
+        options.output = rValue;
+      }
+      else
+      {
+        printUsage(pArgv[0]);
+        return 1;
+      }
+    }
+  }
+  catch (const std::exception& exc)
+  {
+    std::cerr << exc.what() << '\n';
+    printUsage(pArgv[0]);
+    return 1;
+  }
+
+  if (options.output.empty() || options.nodes == 0 || options.globalRatio < 0 || options.globalRatio > 1 ||
+    firstFileId + options.files > UINT16_MAX)
+  {
+    printUsage(pArgv[0]);
+    return 1;
+  }
+
+  try
+  {
+    generate(options);
+  }
+  catch (const std::exception& exc)
+  {
+    std::cerr << exc.what() << '\n';
+    return 1;
+  }
+
+  return 0;
+}
@@ -1,37 +1,289 @@
+#include <algorithm>
 #include <chrono>
+#include <exception>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <string>
 
+#include "batch.hpp"
 #include "epp.hpp"
+#include "profile.hpp"
 
 using namespace epp;
 
+namespace
+{
+uint64_t total(const StallCounts& counts)
+{
+  uint64_t ret = 0;
+
+  for (uint64_t count : counts)
+  {
+    ret += count;
+  }
+
+  return ret;
+}
+
+void printStalls(const StallCounts& counts)
+{
+  for (size_t i = 0; i < counts.size(); i++)
+  {
+    std::cout << (i > 0 ? ", " : " ") << toString(static_cast<StallReason>(i)) << '=' << counts[i];
+  }
+
+  std::cout << '\n';
+}
+} // namespace
+
 int main(int argc, char** pArgv)
 {
-  if (argc != 2)
+  if (argc >= 2 && std::string(pArgv[1]) == "--batch")
+  {
+    return batchMain(std::vector<std::string>(pArgv + 2, pArgv + argc));
+  }
+
+  if (argc == 4 && std::string(pArgv[1]) == "--trace-json")
+  {
+    try
+    {
+      std::ifstream in(pArgv[2], std::ios::binary);
+      std::ofstream out(pArgv[3]);
+      convertTrace(in, out);
+      return 0;
+    }
+    catch (const std::exception& exc)
+    {
+      std::cerr << exc.what() << '\n';
+      return 1;
+    }
+  }
+
+  RunOptions runOptions;
+  NetworkOptions networkOptions;
+  std::string profilePrefix;
+  std::string metricsEndpoint;
+  std::chrono::seconds heartbeat{0};
+  bool badArgs = argc < 2;
+
+  try
+  {
+    for (int i = 2; i < argc && !badArgs; i++)
+    {
+      std::string arg(pArgv[i]);
+      bool hasValue = i + 1 < argc;
+
+      if (arg == "--checkpoint" && hasValue)
+      {
+        runOptions.checkpointPath = pArgv[++i];
+      }
+      else if (arg == "--checkpoint-every" && hasValue)
+      {
+        runOptions.checkpointInterval = parseCount(pArgv[++i]);
+      }
+      else if (arg == "--resume" && hasValue)
+      {
+        runOptions.resumePath = pArgv[++i];
+      }
+      else if (arg == "--profile" && hasValue)
+      {
+        profilePrefix = pArgv[++i];
+        runOptions.profile = true;
+      }
+      else if (arg == "--trace" && hasValue)
+      {
+        runOptions.tracePath = pArgv[++i];
+      }
+      else if (arg == "--dump-file" && hasValue)
+      {
+        networkOptions.dumpPath = pArgv[++i];
+      }
+      else if (arg == "--record" && hasValue)
+      {
+        networkOptions.recordPath = pArgv[++i];
+      }
+      else if (arg == "--replay" && hasValue)
+      {
+        networkOptions.replayPath = pArgv[++i];
+      }
+      else if (arg == "--metrics" && hasValue)
+      {
+        metricsEndpoint = pArgv[++i];
+      }
+      else if (arg == "--heartbeat" && hasValue)
+      {
+        heartbeat = std::chrono::seconds(parseCount(pArgv[++i], std::numeric_limits<std::chrono::seconds::rep>::max()));
+      }
+      else if (arg == "--memory")
+      {
+        runOptions.trackMemory = true;
+      }
+      else if (arg == "--max-cycles" && hasValue)
+      {
+        runOptions.maxCycles = parseCount(pArgv[++i]);
+      }
+      else if (arg == "--max-time" && hasValue)
+      {
+        runOptions.maxTime = std::chrono::milliseconds(parseCount(pArgv[++i], std::numeric_limits<std::chrono::milliseconds::rep>::max()));
+      }
+      else if (arg == "--max-machines" && hasValue)
+      {
+        runOptions.maxMachines = parseCount(pArgv[++i]);
+      }
+      else if (arg == "--max-memory" && hasValue)
+      {
+        runOptions.maxMemory = parseCount(pArgv[++i]);
+      }
+      else
+      {
+        badArgs = true;
+      }
+    }
+  }
+  catch (const std::exception&)
+  {
+    // Unparseable or out-of-range numbers
+    badArgs = true;
+  }
+
+  // A resumed run can't be recorded, and the Network would truncate the log
+  // before the resume could be refused
+  if ((runOptions.checkpointInterval != 0 && runOptions.checkpointPath.empty()) ||
+    (!networkOptions.recordPath.empty() && !networkOptions.replayPath.empty()) ||
+    (!networkOptions.recordPath.empty() && !runOptions.resumePath.empty()))
+  {
+    badArgs = true;
+  }
+
+  if (badArgs)
   {
-    std::cout << "Usage: " << pArgv[0] << " <script>" << '\n';
+    std::cout << "Usage: " << pArgv[0] << " <script> [--checkpoint <path> --checkpoint-every <cycles>] [--resume <path>]" << '\n';
+    std::cout << "         [--max-cycles <n>] [--max-time <ms>] [--max-machines <n>] [--max-memory <bytes>]" << '\n';
+    std::cout << "         [--profile <prefix>]  writes <prefix>.txt listing and <prefix>.folded stacks" << '\n';
+    std::cout << "         [--trace <path>]  writes a binary event log of the run" << '\n';
+    std::cout << "         [--dump-file <path>]  writes DUMP output as binary records for epp-dumpview" << '\n';
+    std::cout << "         [--record <path> | --replay <path>]  logs stdin, file_in, rand and KILL/RAND inputs, or feeds them back; --record not with --resume" << '\n';
+    std::cout << "         [--metrics <port>|unix:<path>]  serves live Prometheus metrics on localhost" << '\n';
+    std::cout << "         [--heartbeat <seconds>]  prints progress to stderr" << '\n';
+    std::cout << "         [--memory]  reports memory by category and node, also through --metrics" << '\n';
+    std::cout << "       " << pArgv[0] << " --batch [options] <script>..." << '\n';
+    std::cout << "       " << pArgv[0] << " --trace-json <trace> <json>  converts a trace for chrome://tracing or Perfetto" << '\n';
     return 1;
   }
 
   try
   {
     auto start = std::chrono::steady_clock::now();
-    Network network(pArgv[1]);
+    Network network(std::make_shared<const Script>(pArgv[1]), networkOptions);
     auto stop = std::chrono::steady_clock::now();
     auto msec = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
     std::cout << "Loaded program in " << msec.count() << "ms\n";
 
+    LiveMetrics metrics;
+    std::unique_ptr<MetricsServer> pMetricsServer;
+
+    if (!metricsEndpoint.empty() || heartbeat.count() > 0)
+    {
+      runOptions.pMetrics = &metrics;
+      pMetricsServer = std::make_unique<MetricsServer>(metrics, metricsEndpoint, heartbeat);
+    }
+
     start = std::chrono::steady_clock::now();
-    RunStats stats = network.run();
+    RunStats stats = network.run(runOptions);
     stop = std::chrono::steady_clock::now();
+    pMetricsServer.reset();
     msec = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
     std::cout << "Executed program in " << msec.count() << "ms\n";
 
+    if (runOptions.profile)
+    {
+      std::ofstream listing(profilePrefix + ".txt");
+      writeListing(listing, network.script(), network.profile());
+
+      std::ofstream collapsed(profilePrefix + ".folded");
+      writeCollapsed(collapsed, network.script(), network.profile());
+    }
+
     std::cout << "Size:     " << stats.size << '\n';
     std::cout << "Cycles:   " << stats.cycles << '\n';
     std::cout << "Activity: " << stats.activity << '\n';
+
+    if (stats.termination != RunStats::Termination::Completed)
+    {
+      std::cout << "Stopped:  " << toString(stats.termination) << '\n';
+    }
+
+    for (const auto& rChannel : stats.channels)
+    {
+      std::cout << "Channel " << rChannel.first << ": sends=" << rChannel.second.sends
+        << " receives=" << rChannel.second.receives
+        << " queued=" << rChannel.second.queuedSends
+        << " peakQueue=" << rChannel.second.peakQueue
+        << " sendStalls=" << rChannel.second.sendStalls
+        << " receiveStalls=" << rChannel.second.receiveStalls << '\n';
+    }
+
+    for (const auto& rProgram : stats.programStalls)
+    {
+      std::cout << "Stalls in " << rProgram.first << ":";
+      printStalls(rProgram.second);
+    }
+
+    // Large networks can have thousands of nodes, so only show the worst
+    std::vector<std::pair<std::string, StallCounts>> nodeStalls = stats.nodeStalls;
+    size_t shownNodes = std::min<size_t>(nodeStalls.size(), 10);
+
+    std::partial_sort(nodeStalls.begin(), nodeStalls.begin() + shownNodes, nodeStalls.end(),
+      [](const auto& rLeft, const auto& rRight)
+      {
+        return total(rLeft.second) > total(rRight.second);
+      });
+
+    for (size_t i = 0; i < shownNodes; i++)
+    {
+      std::cout << "Stalls on node " << nodeStalls[i].first << ":";
+      printStalls(nodeStalls[i].second);
+    }
+
+    if (nodeStalls.size() > shownNodes)
+    {
+      std::cout << "(" << nodeStalls.size() - shownNodes << " more nodes with stalls)\n";
+    }
+
+    if (runOptions.trackMemory)
+    {
+      std::cout << "Memory:   " << totalBytes(stats.memory) << " bytes at end, " << stats.peakMemoryBytes << " peak\n";
+
+      for (size_t i = 0; i < memoryCategoryCount; i++)
+      {
+        std::cout << "Memory in " << toString(static_cast<MemoryCategory>(i)) << ": bytes=" << stats.memory[i].bytes
+          << " blocks=" << stats.memory[i].blocks
+          << " peakBytes=" << stats.peakMemory[i].bytes
+          << " peakBlocks=" << stats.peakMemory[i].blocks << '\n';
+      }
+
+      std::vector<std::pair<std::string, MemoryCounts>> nodeMemory = stats.nodeMemory;
+      size_t shownMemory = std::min<size_t>(nodeMemory.size(), 10);
+
+      std::partial_sort(nodeMemory.begin(), nodeMemory.begin() + shownMemory, nodeMemory.end(),
+        [](const auto& rLeft, const auto& rRight)
+        {
+          return totalBytes(rLeft.second) > totalBytes(rRight.second);
+        });
+
+      for (size_t i = 0; i < shownMemory; i++)
+      {
+        std::cout << "Memory on node " << nodeMemory[i].first << ": " << totalBytes(nodeMemory[i].second) << " bytes\n";
+      }
+
+      if (nodeMemory.size() > shownMemory)
+      {
+        std::cout << "(" << nodeMemory.size() - shownMemory << " more nodes holding memory)\n";
+      }
+    }
   }
-  catch (const Error& exc)
+  catch (const std::exception& exc)
   {
     std::cerr << exc.what() << '\n';
   }
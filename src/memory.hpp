@@ -0,0 +1,47 @@
+#ifndef EPP_MEMORY_HPP
+#define EPP_MEMORY_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace epp
+{
+// What heap memory is holding. Strings covers the text of string values
+// wherever they are; the vectors or slots holding those values count under
+// their owner.
+enum class MemoryCategory : uint8_t
+{
+  Files, // File records and their values, in nodes or held by machines
+  Machines, // Machine table slots and the records of live machines
+  Names, // Records of ended machines, kept while a replica needs their name
+  Strings,
+  Code, // Program code and source maps, shared by every copy of a program
+  Channels // Channel buffers and queued senders
+};
+
+constexpr size_t memoryCategoryCount = static_cast<size_t>(MemoryCategory::Channels) + 1;
+
+struct MemoryUsage
+{
+  uint64_t bytes = 0;
+  uint64_t blocks = 0; // Separate heap allocations
+};
+
+using MemoryCounts = std::array<MemoryUsage, memoryCategoryCount>;
+
+// Filled in by walking the network. Counts reserved capacity, but not
+// allocator overhead.
+struct MemoryReport
+{
+  MemoryCounts total{};
+  std::vector<MemoryCounts> nodes; // Indexed like the script's nodes; excludes Names and Code
+};
+
+const char* toString(MemoryCategory category);
+
+uint64_t totalBytes(const MemoryCounts& counts);
+} // namespace epp
+
+#endif // EPP_MEMORY_HPP
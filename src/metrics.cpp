@@ -0,0 +1,230 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include "epp.hpp"
+#include "metrics.hpp"
+
+namespace epp
+{
+namespace
+{
+int listenTcp(const std::string& port)
+{
+  unsigned long number = std::stoul(port);
+  if (number == 0 || number > 65535)
+  {
+    throw Error("Invalid metrics port: " + port);
+  }
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(static_cast<uint16_t>(number));
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int reuse = 1;
+
+  if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 || bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, 4) != 0)
+  {
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+
+    throw Error("Could not listen on metrics port " + port + ": " + std::strerror(errno));
+  }
+
+  return fd;
+}
+
+int listenUnix(const std::string& path)
+{
+  sockaddr_un address{};
+  if (path.size() >= sizeof(address.sun_path))
+  {
+    throw Error("Metrics socket path is too long: " + path);
+  }
+
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+  // Clear out a socket left by an earlier run, but never anything else
+  struct stat info{};
+  if (lstat(path.c_str(), &info) == 0)
+  {
+    if (!S_ISSOCK(info.st_mode))
+    {
+      throw Error("Metrics socket path exists and is not a socket: " + path);
+    }
+
+    unlink(path.c_str());
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, 4) != 0)
+  {
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+
+    throw Error("Could not listen on metrics socket " + path + ": " + std::strerror(errno));
+  }
+
+  return fd;
+}
+
+void writeMetric(std::ostream& rStream, const char* pName, const char* pType, const char* pHelp, uint64_t value)
+{
+  rStream << "# HELP " << pName << ' ' << pHelp << '\n';
+  rStream << "# TYPE " << pName << ' ' << pType << '\n';
+  rStream << pName << ' ' << value << '\n';
+}
+
+void writeCategories(std::ostream& rStream, const char* pName, const char* pHelp,
+  const std::array<std::atomic<uint64_t>, memoryCategoryCount>& values)
+{
+  rStream << "# HELP " << pName << ' ' << pHelp << '\n';
+  rStream << "# TYPE " << pName << " gauge\n";
+
+  for (size_t category = 0; category < memoryCategoryCount; category++)
+  {
+    rStream << pName << "{category=\"" << toString(static_cast<MemoryCategory>(category)) << "\"} "
+      << values[category].load(std::memory_order_relaxed) << '\n';
+  }
+}
+} // namespace
+
+MetricsServer::MetricsServer(const LiveMetrics& metrics, const std::string& endpoint, std::chrono::seconds heartbeat)
+  : metrics(metrics),
+  unixPath(),
+  listener(-1),
+  heartbeat(heartbeat),
+  lastBeat(std::chrono::steady_clock::now()),
+  lastCycles(0),
+  stopping(false),
+  thread()
+{
+  if (endpoint.rfind("unix:", 0) == 0)
+  {
+    unixPath = endpoint.substr(5);
+    listener = listenUnix(unixPath);
+  }
+  else if (!endpoint.empty())
+  {
+    listener = listenTcp(endpoint);
+  }
+
+  thread = std::thread(&MetricsServer::serve, this);
+}
+
+MetricsServer::~MetricsServer()
+{
+  stopping.store(true);
+  thread.join();
+
+  if (listener >= 0)
+  {
+    close(listener);
+  }
+
+  if (!unixPath.empty())
+  {
+    unlink(unixPath.c_str());
+  }
+}
+
+void MetricsServer::serve()
+{
+  while (!stopping.load())
+  {
+    // Wakes often enough to notice shutdown promptly
+    pollfd poller{listener, POLLIN, 0};
+    if (listener >= 0 && poll(&poller, 1, 100) > 0)
+    {
+      int client = accept(listener, nullptr, nullptr);
+      if (client >= 0)
+      {
+        respond(client);
+        close(client);
+      }
+    }
+    else if (listener < 0)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    if (heartbeat.count() > 0 && std::chrono::steady_clock::now() - lastBeat >= heartbeat)
+    {
+      printHeartbeat();
+    }
+  }
+}
+
+void MetricsServer::respond(int client) const
+{
+  // The request itself doesn't matter; every path gets the metrics
+  char request[1024];
+  pollfd poller{client, POLLIN, 0};
+  if (poll(&poller, 1, 100) > 0)
+  {
+    static_cast<void>(read(client, request, sizeof(request)));
+  }
+
+  std::ostringstream body;
+  writeMetric(body, "epp_cycles_total", "counter", "Cycles executed", metrics.cycles.load(std::memory_order_relaxed));
+  writeMetric(body, "epp_activity_total", "counter", "LINK and KILL instructions executed", metrics.activity.load(std::memory_order_relaxed));
+  writeMetric(body, "epp_machines", "gauge", "Live machines", metrics.machines.load(std::memory_order_relaxed));
+  writeMetric(body, "epp_memory_bytes", "gauge", "Estimated bytes held by machines, files and channels", metrics.memoryBytes.load(std::memory_order_relaxed));
+  writeMetric(body, "epp_channel_values", "gauge", "Values held in channels", metrics.channelValues.load(std::memory_order_relaxed));
+  writeMetric(body, "epp_channel_queued_senders", "gauge", "Machines waiting to send on a full channel", metrics.queuedSenders.load(std::memory_order_relaxed));
+  writeMetric(body, "epp_running", "gauge", "1 while a run is in progress", metrics.running.load(std::memory_order_relaxed));
+  writeMetric(body, "epp_memory_peak_bytes", "gauge", "Highest total of epp_memory_category_bytes seen", metrics.peakMemoryBytes.load(std::memory_order_relaxed));
+  writeCategories(body, "epp_memory_category_bytes", "Bytes held, by what holds them", metrics.categoryBytes);
+  writeCategories(body, "epp_memory_category_blocks", "Heap allocations, by what holds them", metrics.categoryBlocks);
+
+  std::string text = body.str();
+  std::ostringstream response;
+  response << "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " << text.size() << "\r\n\r\n" << text;
+
+  std::string bytes = response.str();
+  size_t sent = 0;
+  while (sent < bytes.size())
+  {
+    ssize_t count = send(client, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+    if (count <= 0)
+    {
+      break;
+    }
+
+    sent += static_cast<size_t>(count);
+  }
+}
+
+void MetricsServer::printHeartbeat()
+{
+  auto now = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(now - lastBeat).count();
+  uint64_t cycles = metrics.cycles.load(std::memory_order_relaxed);
+
+  std::ostringstream line;
+  line << "[epp] cycle " << cycles << " (" << static_cast<uint64_t>((cycles - lastCycles) / seconds) << "/s), "
+    << metrics.machines.load(std::memory_order_relaxed) << " machines, "
+    << metrics.channelValues.load(std::memory_order_relaxed) << " channel values, "
+    << metrics.memoryBytes.load(std::memory_order_relaxed) << " bytes\n";
+  std::cerr << line.str();
+
+  lastBeat = now;
+  lastCycles = cycles;
+}
+} // namespace epp
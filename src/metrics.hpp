@@ -0,0 +1,62 @@
+#ifndef EPP_METRICS_HPP
+#define EPP_METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "memory.hpp"
+
+namespace epp
+{
+// Counters a running Network publishes for other threads to read. The run
+// stores them with relaxed atomics every so often rather than every cycle.
+struct LiveMetrics
+{
+  std::atomic<uint64_t> cycles{0};
+  std::atomic<uint64_t> activity{0};
+  std::atomic<uint64_t> machines{0};
+  std::atomic<uint64_t> memoryBytes{0}; // As estimated by Network::memoryEstimate()
+  std::atomic<uint64_t> channelValues{0}; // Held in global and local channels
+  std::atomic<uint64_t> queuedSenders{0}; // Waiting for room in a channel
+  std::array<std::atomic<uint64_t>, memoryCategoryCount> categoryBytes{}; // See Network::memoryReport(); zero unless RunOptions::trackMemory
+  std::array<std::atomic<uint64_t>, memoryCategoryCount> categoryBlocks{};
+  std::atomic<uint64_t> peakMemoryBytes{0};
+  std::atomic<bool> running{false};
+};
+
+// Serves LiveMetrics in Prometheus text format and prints a heartbeat line to
+// stderr, both from a background thread. The endpoint is a localhost TCP port
+// or "unix:<path>" for a Unix-domain socket; either part may be disabled.
+class MetricsServer
+{
+public:
+  MetricsServer(const LiveMetrics& metrics, const std::string& endpoint, std::chrono::seconds heartbeat);
+
+  ~MetricsServer();
+
+  MetricsServer(const MetricsServer&) = delete;
+  MetricsServer& operator=(const MetricsServer&) = delete;
+
+private:
+  void serve();
+
+  void respond(int client) const;
+
+  void printHeartbeat();
+
+  const LiveMetrics& metrics;
+  std::string unixPath; // Removed again on shutdown
+  int listener;
+  std::chrono::seconds heartbeat;
+  std::chrono::steady_clock::time_point lastBeat;
+  uint64_t lastCycles;
+  std::atomic<bool> stopping;
+  std::thread thread;
+};
+} // namespace epp
+
+#endif // EPP_METRICS_HPP
@@ -0,0 +1,610 @@
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include "batch.hpp"
+#include "epp.hpp"
+
+// Runs a corpus of scripts several times each and compares load time, run
+// time, instructions per second and peak RSS against a stored baseline.
+// Each run is forked, so every sample starts from the same heap and its peak
+// RSS is its own.
+using namespace epp;
+
+namespace
+{
+using Metrics = std::map<std::string, double>;
+
+struct Sample
+{
+  double loadMs;
+  double runMs;
+  uint64_t machineCycles;
+  double peakRssKb;
+};
+
+// What a forked run sends back to the parent
+struct ChildReport
+{
+  double loadMs;
+  double runMs;
+  uint64_t machineCycles;
+  char error[256];
+};
+
+struct Options
+{
+  std::vector<std::filesystem::path> corpus;
+  std::filesystem::path baseline = "perf/baseline.json";
+  std::filesystem::path output;
+  size_t runs = 5;
+  size_t warmup = 1;
+  double tolerance = 0.15;
+  bool update = false;
+};
+
+// Times and memory below these are mostly noise, so they can't regress
+constexpr double minMs = 2.0;
+constexpr double minRssKb = 2048.0;
+
+// A script that deadlocks would otherwise hang the whole check
+constexpr std::chrono::seconds maxRunTime{120};
+
+// Runs in a copy of the script's directory, since scripts name their files
+// relative to the working directory and registers may write files there
+Sample runOnce(const std::filesystem::path& directory, const std::filesystem::path& script)
+{
+  int fds[2];
+  if (pipe(fds) != 0)
+  {
+    throw Error("Could not create a pipe");
+  }
+
+  pid_t child = fork();
+  if (child < 0)
+  {
+    throw Error("Could not fork");
+  }
+
+  if (child == 0)
+  {
+    close(fds[0]);
+    ChildReport report{};
+
+    // Scripts with a stdin register would otherwise wait on the terminal
+    int null = open("/dev/null", O_RDONLY);
+    if (null >= 0)
+    {
+      dup2(null, STDIN_FILENO);
+      close(null);
+    }
+
+    try
+    {
+      std::filesystem::current_path(directory);
+
+      NetworkOptions options;
+      options.pLog = nullptr;
+      options.pDump = nullptr;
+      options.writeFiles = false;
+
+      auto start = std::chrono::steady_clock::now();
+      Network network(std::make_shared<const Script>(script), options);
+      auto loaded = std::chrono::steady_clock::now();
+      RunOptions runOptions;
+      runOptions.maxTime = maxRunTime;
+      RunStats stats = network.run(runOptions);
+      auto stop = std::chrono::steady_clock::now();
+
+      if (stats.termination != RunStats::Termination::Completed)
+      {
+        throw Error(std::string("Stopped at ") + toString(stats.termination));
+      }
+
+      report.loadMs = std::chrono::duration<double, std::milli>(loaded - start).count();
+      report.runMs = std::chrono::duration<double, std::milli>(stop - loaded).count();
+      report.machineCycles = stats.machineCycles;
+    }
+    catch (const std::exception& exc)
+    {
+      std::snprintf(report.error, sizeof(report.error), "%s", exc.what());
+    }
+
+    static_cast<void>(write(fds[1], &report, sizeof(report)));
+    close(fds[1]);
+    _exit(0);
+  }
+
+  close(fds[1]);
+  ChildReport report{};
+  bool complete = read(fds[0], &report, sizeof(report)) == static_cast<ssize_t>(sizeof(report));
+  close(fds[0]);
+
+  int status = 0;
+  rusage usage{};
+  wait4(child, &status, 0, &usage);
+
+  if (!complete || !WIFEXITED(status))
+  {
+    throw Error(script.string() + ": run crashed");
+  }
+
+  if (report.error[0] != '\0')
+  {
+    throw Error(script.string() + ": " + report.error);
+  }
+
+  return Sample{report.loadMs, report.runMs, report.machineCycles, static_cast<double>(usage.ru_maxrss)};
+}
+
+double percentile(std::vector<double> values, double fraction)
+{
+  std::sort(values.begin(), values.end());
+  size_t rank = static_cast<size_t>(std::ceil(fraction * values.size()));
+  return values[std::max<size_t>(rank, 1) - 1];
+}
+
+Metrics summarize(const std::vector<Sample>& samples)
+{
+  std::vector<double> load;
+  std::vector<double> run;
+  std::vector<double> ips;
+  double rss = 0;
+
+  for (const auto& rSample : samples)
+  {
+    load.push_back(rSample.loadMs);
+    run.push_back(rSample.runMs);
+    ips.push_back(rSample.runMs > 0 ? rSample.machineCycles / (rSample.runMs / 1000.0) : 0.0);
+    rss = std::max(rss, rSample.peakRssKb);
+  }
+
+  return Metrics{
+    {"load_ms_median", percentile(load, 0.5)},
+    {"load_ms_p95", percentile(load, 0.95)},
+    {"run_ms_median", percentile(run, 0.5)},
+    {"run_ms_p95", percentile(run, 0.95)},
+    {"instructions_per_sec", percentile(ips, 0.5)},
+    {"peak_rss_kb", rss}
+  };
+}
+
+// Describes each way current is worse than baseline by more than the tolerance
+std::vector<std::string> compare(const Metrics& current, const Metrics& baseline, double tolerance)
+{
+  std::vector<std::string> ret;
+
+  for (const auto& rPair : baseline)
+  {
+    auto iter = current.find(rPair.first);
+    if (iter == current.end() || rPair.second <= 0)
+    {
+      continue;
+    }
+
+    double base = rPair.second;
+    double now = iter->second;
+    bool worse;
+
+    if (rPair.first == "instructions_per_sec")
+    {
+      // Too short a run to measure a rate
+      worse = baseline.count("run_ms_median") && baseline.at("run_ms_median") >= minMs * 5 && now < base * (1 - tolerance);
+    }
+    else
+    {
+      double floor = rPair.first == "peak_rss_kb" ? minRssKb : minMs;
+      worse = now > base * (1 + tolerance) && now - base > floor;
+    }
+
+    if (worse)
+    {
+      char buffer[128];
+      std::snprintf(buffer, sizeof(buffer), "%s %+.1f%%", rPair.first.c_str(), 100.0 * (now - base) / base);
+      ret.push_back(buffer);
+    }
+  }
+
+  return ret;
+}
+
+// Reads the baseline format written by writeBaseline: an object of workloads,
+// each an object of numbers
+class BaselineParser
+{
+public:
+  explicit BaselineParser(std::string&& text)
+    : text(std::move(text)),
+    pos(0)
+  {
+    // Empty
+  }
+
+  std::map<std::string, Metrics> parse()
+  {
+    std::map<std::string, Metrics> ret;
+
+    expect('{');
+    while (!consume('}'))
+    {
+      std::string key = string();
+      expect(':');
+
+      if (key != "workloads")
+      {
+        throw Error("Unexpected baseline key: " + key);
+      }
+
+      expect('{');
+      while (!consume('}'))
+      {
+        std::string name = string();
+        expect(':');
+        expect('{');
+
+        Metrics& rMetrics = ret[name];
+        while (!consume('}'))
+        {
+          std::string metric = string();
+          expect(':');
+          rMetrics[metric] = number();
+          consume(',');
+        }
+
+        consume(',');
+      }
+
+      consume(',');
+    }
+
+    return ret;
+  }
+
+private:
+  void skipSpace()
+  {
+    while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos])))
+    {
+      pos++;
+    }
+  }
+
+  bool consume(char c)
+  {
+    skipSpace();
+    if (pos < text.size() && text[pos] == c)
+    {
+      pos++;
+      return true;
+    }
+
+    return false;
+  }
+
+  void expect(char c)
+  {
+    if (!consume(c))
+    {
+      throw Error(std::string("Malformed baseline: expected '") + c + "' at offset " + std::to_string(pos));
+    }
+  }
+
+  std::string string()
+  {
+    expect('"');
+    std::string ret;
+
+    while (pos < text.size() && text[pos] != '"')
+    {
+      if (text[pos] == '\\' && pos + 1 < text.size())
+      {
+        pos++;
+      }
+
+      ret += text[pos++];
+    }
+
+    expect('"');
+    return ret;
+  }
+
+  double number()
+  {
+    skipSpace();
+    size_t used = 0;
+    double ret = std::stod(text.substr(pos, 32), &used);
+    pos += used;
+    return ret;
+  }
+
+  std::string text;
+  size_t pos;
+};
+
+std::string jsonString(const std::string& str)
+{
+  std::string ret = "\"";
+
+  for (char c : str)
+  {
+    if (c == '"' || c == '\\')
+    {
+      ret += '\\';
+    }
+
+    ret += c;
+  }
+
+  return ret + '"';
+}
+
+void writeBaseline(std::ostream& rStream, const std::map<std::string, Metrics>& results)
+{
+  rStream << "{\n  \"workloads\": {";
+  bool firstWorkload = true;
+
+  for (const auto& rWorkload : results)
+  {
+    rStream << (firstWorkload ? "\n" : ",\n") << "    " << jsonString(rWorkload.first) << ": {";
+    firstWorkload = false;
+    bool firstMetric = true;
+
+    for (const auto& rMetric : rWorkload.second)
+    {
+      char buffer[64];
+      std::snprintf(buffer, sizeof(buffer), "%.3f", rMetric.second);
+      rStream << (firstMetric ? "" : ", ") << jsonString(rMetric.first) << ": " << buffer;
+      firstMetric = false;
+    }
+
+    rStream << '}';
+  }
+
+  rStream << "\n  }\n}\n";
+}
+
+std::vector<std::filesystem::path> findScripts(const std::vector<std::filesystem::path>& corpus)
+{
+  std::vector<std::filesystem::path> ret;
+
+  for (const auto& rPath : corpus)
+  {
+    if (std::filesystem::is_directory(rPath))
+    {
+      for (const auto& rEntry : std::filesystem::directory_iterator(rPath))
+      {
+        if (rEntry.path().extension() == ".epp")
+        {
+          ret.push_back(rEntry.path());
+        }
+      }
+    }
+    else
+    {
+      ret.push_back(rPath);
+    }
+  }
+
+  std::sort(ret.begin(), ret.end());
+  return ret;
+}
+
+// Copies each directory holding a script into the scratch directory once
+class Workspace
+{
+public:
+  Workspace()
+    : root(std::filesystem::temp_directory_path() / ("epp_perfcheck." + std::to_string(getpid()))),
+    copies()
+  {
+    std::filesystem::create_directories(root);
+  }
+
+  ~Workspace()
+  {
+    std::error_code error;
+    std::filesystem::remove_all(root, error);
+  }
+
+  std::filesystem::path copyFor(const std::filesystem::path& script)
+  {
+    std::filesystem::path source = std::filesystem::absolute(script).parent_path();
+    auto iter = copies.find(source);
+
+    if (iter == copies.end())
+    {
+      std::filesystem::path copy = root / std::to_string(copies.size());
+      std::filesystem::copy(source, copy, std::filesystem::copy_options::recursive);
+      iter = copies.emplace(source, copy).first;
+    }
+
+    return iter->second;
+  }
+
+private:
+  std::filesystem::path root;
+  std::map<std::filesystem::path, std::filesystem::path> copies;
+};
+
+void printUsage(const char* pProgram)
+{
+  std::cout << "Usage: " << pProgram << " [options] [<script or directory>...]\n"
+    "Runs every script (default: examples and perf) and compares against a baseline.\n"
+    "  --runs <n>         Timed runs per script (default: 5)\n"
+    "  --warmup <n>       Untimed runs first (default: 1)\n"
+    "  --baseline <path>  Baseline JSON (default: perf/baseline.json)\n"
+    "  --tolerance <f>    Allowed slowdown as a fraction (default: 0.15)\n"
+    "  --update           Write the results as the new baseline instead of comparing\n"
+    "  --output <path>    Also write the results as JSON\n";
+}
+} // namespace
+
+int main(int argc, char** pArgv)
+{
+  Options options;
+  std::vector<std::string> args(pArgv + 1, pArgv + argc);
+
+  try
+  {
+    for (size_t i = 0; i < args.size(); i++)
+    {
+      const std::string& rArg = args[i];
+      bool hasValue = i + 1 < args.size();
+
+      if (rArg == "--runs" && hasValue)
+      {
+        options.runs = parseCount(args[++i]);
+      }
+      else if (rArg == "--warmup" && hasValue)
+      {
+        options.warmup = parseCount(args[++i]);
+      }
+      else if (rArg == "--baseline" && hasValue)
+      {
+        options.baseline = args[++i];
+      }
+      else if (rArg == "--tolerance" && hasValue)
+      {
+        options.tolerance = parseFraction(args[++i]);
+      }
+      else if (rArg == "--output" && hasValue)
+      {
+        options.output = args[++i];
+      }
+      else if (rArg == "--update")
+      {
+        options.update = true;
+      }
+      else if (rArg.rfind("--", 0) == 0)
+      {
+        printUsage(pArgv[0]);
+        return 2;
+      }
+      else
+      {
+        options.corpus.emplace_back(rArg);
+      }
+    }
+  }
+  catch (const std::exception&)
+  {
+    printUsage(pArgv[0]);
+    return 2;
+  }
+
+  if (options.runs == 0)
+  {
+    printUsage(pArgv[0]);
+    return 2;
+  }
+
+  if (options.corpus.empty())
+  {
+    options.corpus = {"examples", "perf"};
+  }
+
+  try
+  {
+    std::map<std::string, Metrics> baseline;
+
+    if (!options.update)
+    {
+      std::ifstream in(options.baseline);
+      if (in)
+      {
+        std::stringstream text;
+        text << in.rdbuf();
+        baseline = BaselineParser(text.str()).parse();
+      }
+      else
+      {
+        std::cout << "No baseline at " << options.baseline.string() << "; only reporting\n";
+      }
+    }
+
+    std::map<std::string, Metrics> results;
+    size_t regressions = 0;
+    Workspace workspace;
+
+    std::printf("%-28s %9s %9s %10s %10s %10s %9s  %s\n", "workload", "load p50", "load p95", "run p50", "run p95", "Minst/s", "RSS MB", "status");
+
+    for (const auto& rScript : findScripts(options.corpus))
+    {
+      std::string name = rScript.generic_string();
+      std::filesystem::path directory = workspace.copyFor(rScript);
+
+      for (size_t i = 0; i < options.warmup; i++)
+      {
+        runOnce(directory, rScript.filename());
+      }
+
+      std::vector<Sample> samples;
+      for (size_t i = 0; i < options.runs; i++)
+      {
+        samples.push_back(runOnce(directory, rScript.filename()));
+      }
+
+      Metrics& rMetrics = results[name] = summarize(samples);
+      std::string status = "new";
+
+      auto base = baseline.find(name);
+      if (options.update)
+      {
+        status = "recorded";
+      }
+      else if (base != baseline.end())
+      {
+        std::vector<std::string> problems = compare(rMetrics, base->second, options.tolerance);
+        status = problems.empty() ? "ok" : "REGRESSED";
+
+        for (const auto& rProblem : problems)
+        {
+          status += ' ' + rProblem;
+        }
+
+        regressions += !problems.empty();
+      }
+
+      std::printf("%-28s %9.2f %9.2f %10.2f %10.2f %10.2f %9.1f  %s\n", name.c_str(),
+        rMetrics["load_ms_median"], rMetrics["load_ms_p95"], rMetrics["run_ms_median"], rMetrics["run_ms_p95"],
+        rMetrics["instructions_per_sec"] / 1e6, rMetrics["peak_rss_kb"] / 1024, status.c_str());
+    }
+
+    if (options.update)
+    {
+      std::ofstream out(options.baseline);
+      writeBaseline(out, results);
+    }
+
+    if (!options.output.empty())
+    {
+      std::ofstream out(options.output);
+      writeBaseline(out, results);
+    }
+
+    if (regressions > 0)
+    {
+      std::cout << regressions << " workload(s) regressed beyond " << options.tolerance * 100 << "%\n";
+      return 1;
+    }
+  }
+  catch (const std::exception& exc)
+  {
+    std::cerr << exc.what() << '\n';
+    return 2;
+  }
+
+  return 0;
+}
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <sstream>
+
+#include "profile.hpp"
+
+namespace epp
+{
+namespace
+{
+struct LineTotals
+{
+  uint64_t executions = 0;
+  uint64_t blocked = 0;
+  std::map<uint32_t, InstructionProfile> repCopies; // Keyed by @rep iteration
+};
+
+void writeCounts(std::ostream& rStream, uint64_t executions, uint64_t blocked, uint64_t total)
+{
+  uint64_t cycles = executions + blocked;
+  double share = total > 0 ? 100.0 * cycles / total : 0.0;
+
+  char buffer[64];
+  std::snprintf(buffer, sizeof(buffer), "%12llu %12llu %12llu %6.2f%%",
+    static_cast<unsigned long long>(executions), static_cast<unsigned long long>(blocked),
+    static_cast<unsigned long long>(cycles), share);
+  rStream << buffer;
+}
+
+// Frames are separated by semicolons, so none may appear inside one
+std::string frame(std::string text)
+{
+  std::replace(text.begin(), text.end(), ';', ',');
+  return text;
+}
+} // namespace
+
+void writeListing(std::ostream& rStream, const Script& script, const Profile& profile)
+{
+  std::vector<LineTotals> lines(script.sourceText.size() + 1);
+  uint64_t total = 0;
+
+  for (const auto& rpProgram : script.programs)
+  {
+    if (rpProgram->index >= profile.counts.size())
+    {
+      continue;
+    }
+
+    const auto& rCounts = profile.counts[rpProgram->index];
+
+    for (size_t address = 0; address < rCounts.size(); address++)
+    {
+      const SourceLine& rSource = rpProgram->source[address];
+
+      if (rSource.line >= lines.size())
+      {
+        continue;
+      }
+
+      LineTotals& rLine = lines[rSource.line];
+      rLine.executions += rCounts[address].executions;
+      rLine.blocked += rCounts[address].blocked;
+      total += rCounts[address].executions + rCounts[address].blocked;
+
+      if (rSource.repLine != 0)
+      {
+        InstructionProfile& rCopy = rLine.repCopies[rSource.repIteration];
+        rCopy.executions += rCounts[address].executions;
+        rCopy.blocked += rCounts[address].blocked;
+      }
+    }
+  }
+
+  rStream << "; Profile of " << script.path.string() << ": " << total << " machine cycles\n";
+  rStream << ";   executions      blocked       cycles   share  line  source\n";
+
+  for (size_t line = 1; line < lines.size(); line++)
+  {
+    const LineTotals& rLine = lines[line];
+    bool hasCode = rLine.executions + rLine.blocked > 0;
+
+    if (hasCode)
+    {
+      writeCounts(rStream, rLine.executions, rLine.blocked, total);
+    }
+    else
+    {
+      rStream << std::string(46, ' ');
+    }
+
+    char lineNumber[32]; // Room for any size_t
+    std::snprintf(lineNumber, sizeof(lineNumber), " %5zu  ", line);
+    rStream << lineNumber << script.sourceText[line - 1] << '\n';
+
+    if (rLine.repCopies.size() > 1)
+    {
+      for (const auto& rPair : rLine.repCopies)
+      {
+        writeCounts(rStream, rPair.second.executions, rPair.second.blocked, total);
+        rStream << "          @rep copy " << rPair.first << '\n';
+      }
+    }
+  }
+}
+
+void writeCollapsed(std::ostream& rStream, const Script& script, const Profile& profile)
+{
+  std::string root = frame(script.path.filename().string());
+
+  for (const auto& rpProgram : script.programs)
+  {
+    if (rpProgram->index >= profile.counts.size())
+    {
+      continue;
+    }
+
+    const auto& rCounts = profile.counts[rpProgram->index];
+
+    for (size_t address = 0; address < rCounts.size(); address++)
+    {
+      uint64_t cycles = rCounts[address].executions + rCounts[address].blocked;
+
+      if (cycles == 0)
+      {
+        continue;
+      }
+
+      const SourceLine& rSource = rpProgram->source[address];
+      rStream << root << ';' << frame(rpProgram->name) << ';';
+
+      if (rSource.repLine != 0)
+      {
+        rStream << "@rep L" << rSource.repLine << ";copy " << rSource.repIteration << ';';
+      }
+
+      std::ostringstream inst;
+      inst << 'L' << rSource.line << ' ' << rpProgram->code[address];
+
+      rStream << frame(inst.str()) << ' ' << cycles << '\n';
+    }
+  }
+}
+} // namespace epp
@@ -0,0 +1,19 @@
+#ifndef EPP_PROFILE_HPP
+#define EPP_PROFILE_HPP
+
+#include <ostream>
+
+#include "epp.hpp"
+
+namespace epp
+{
+// The script's source with per-line executions, blocked cycles and share of
+// all machine cycles; lines that came from @rep show the copies separately
+void writeListing(std::ostream& rStream, const Script& script, const Profile& profile);
+
+// One line per instruction in the "frame;frame;frame count" form read by
+// flamegraph.pl and similar tools, weighted by machine cycles
+void writeCollapsed(std::ostream& rStream, const Script& script, const Profile& profile);
+} // namespace epp
+
+#endif // EPP_PROFILE_HPP
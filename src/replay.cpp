@@ -0,0 +1,223 @@
+#include <cstring>
+#include <sstream>
+
+#include "epp.hpp"
+#include "replay.hpp"
+
+namespace epp
+{
+InputRecorder::InputRecorder(const std::filesystem::path& path)
+  : path(path),
+  buffer(),
+  flushed(0),
+  stream(path, std::ios::binary | std::ios::trunc)
+{
+  if (!stream)
+  {
+    throw Error("Could not open input log: " + path.string());
+  }
+
+  buffer.reserve(flushSize);
+  buffer.append(inputLogMagic, sizeof(inputLogMagic));
+}
+
+InputRecorder::~InputRecorder()
+{
+  stream.write(buffer.data(), buffer.size());
+}
+
+void InputRecorder::number(uint32_t reg, int64_t value)
+{
+  buffer.push_back(static_cast<char>(InputRecord::Number));
+  varint(reg);
+  varint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+  commit();
+}
+
+void InputRecorder::string(uint32_t reg, const std::string& value)
+{
+  buffer.push_back(static_cast<char>(InputRecord::String));
+  varint(reg);
+  varint(value.size());
+  buffer.append(value);
+  commit();
+}
+
+void InputRecorder::draw(uint64_t value)
+{
+  buffer.push_back(static_cast<char>(InputRecord::Draw));
+  buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  commit();
+}
+
+void InputRecorder::pick(uint64_t index)
+{
+  buffer.push_back(static_cast<char>(InputRecord::Pick));
+  varint(index);
+  commit();
+}
+
+uint64_t InputRecorder::position() const
+{
+  return flushed + buffer.size();
+}
+
+void InputRecorder::varint(uint64_t value)
+{
+  while (value >= 0x80)
+  {
+    buffer.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+
+  buffer.push_back(static_cast<char>(value));
+}
+
+void InputRecorder::commit()
+{
+  if (buffer.size() >= flushSize)
+  {
+    flush();
+  }
+}
+
+void InputRecorder::flush()
+{
+  stream.write(buffer.data(), buffer.size());
+  stream.flush();
+  flushed += buffer.size();
+  buffer.clear();
+
+  if (!stream.good())
+  {
+    throw Error("Could not write input log: " + path.string());
+  }
+}
+
+InputReplayer::InputReplayer(const std::filesystem::path& path)
+  : buffer(),
+  offset(sizeof(inputLogMagic))
+{
+  std::ifstream stream(path, std::ios::binary);
+  if (!stream)
+  {
+    throw Error("Could not open input log: " + path.string());
+  }
+
+  std::ostringstream contents;
+  contents << stream.rdbuf();
+  buffer = contents.str();
+
+  if (buffer.size() < sizeof(inputLogMagic) || std::memcmp(buffer.data(), inputLogMagic, sizeof(inputLogMagic)) != 0)
+  {
+    throw Error("Not an input log: " + path.string());
+  }
+}
+
+InputRecord InputReplayer::registerRead(uint32_t reg)
+{
+  InputRecord type = record();
+
+  if ((type != InputRecord::Number && type != InputRecord::String) || varint() != reg)
+  {
+    throw Error("Run diverged from input log: expected a different register read");
+  }
+
+  return type;
+}
+
+int64_t InputReplayer::number()
+{
+  uint64_t zigzag = varint();
+  return static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+}
+
+std::string InputReplayer::string()
+{
+  uint64_t length = varint();
+  if (length > buffer.size() - offset)
+  {
+    throw Error("Input log is truncated");
+  }
+
+  std::string ret = buffer.substr(offset, length);
+  offset += length;
+  return ret;
+}
+
+uint64_t InputReplayer::draw()
+{
+  if (record() != InputRecord::Draw)
+  {
+    throw Error("Run diverged from input log: expected a RAND draw");
+  }
+
+  uint64_t ret = 0;
+  if (sizeof(ret) > buffer.size() - offset)
+  {
+    throw Error("Input log is truncated");
+  }
+
+  std::memcpy(&ret, buffer.data() + offset, sizeof(ret));
+  offset += sizeof(ret);
+  return ret;
+}
+
+uint64_t InputReplayer::pick()
+{
+  if (record() != InputRecord::Pick)
+  {
+    throw Error("Run diverged from input log: expected a KILL target");
+  }
+
+  return varint();
+}
+
+uint64_t InputReplayer::position() const
+{
+  return offset;
+}
+
+void InputReplayer::seek(uint64_t position)
+{
+  if (position < sizeof(inputLogMagic) || position > buffer.size())
+  {
+    throw Error("Checkpoint is past the end of the input log");
+  }
+
+  offset = position;
+}
+
+InputRecord InputReplayer::record()
+{
+  if (offset >= buffer.size())
+  {
+    throw Error("Run read more input than the input log holds");
+  }
+
+  return static_cast<InputRecord>(buffer[offset++]);
+}
+
+uint64_t InputReplayer::varint()
+{
+  uint64_t ret = 0;
+
+  for (unsigned shift = 0; shift < 64; shift += 7)
+  {
+    if (offset >= buffer.size())
+    {
+      throw Error("Input log is truncated");
+    }
+
+    auto byte = static_cast<uint8_t>(buffer[offset++]);
+    ret |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+    if (!(byte & 0x80))
+    {
+      return ret;
+    }
+  }
+
+  throw Error("Input log is corrupt");
+}
+} // namespace epp
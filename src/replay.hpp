@@ -0,0 +1,102 @@
+#ifndef EPP_REPLAY_HPP
+#define EPP_REPLAY_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+// Recorded nondeterministic inputs: reads of stdin, file_in and rand
+// registers, and draws from Network::random for KILL and RAND. A replay hands
+// them back in the order they were recorded from a buffer loaded up front, so
+// the rerun does no input I/O and takes exactly the cycles the recording did.
+//
+// The file is the magic followed by records, each a u8 InputRecord and a body:
+//   Number: register index, zigzag value
+//   String: register index, length, bytes
+//   Draw: u64, native-endian
+//   Pick: index
+// Indexes and lengths are LEB128 varints, as is the zigzag value.
+namespace epp
+{
+constexpr char inputLogMagic[8] = {'E', 'P', 'P', 'I', 'N', 'P', 'U', 'T'};
+
+enum class InputRecord : uint8_t
+{
+  Number, // Register read
+  String, // Register read
+  Draw, // RAND
+  Pick // KILL target
+};
+
+// Write failures throw Error, except from the destructor
+class InputRecorder
+{
+public:
+  explicit InputRecorder(const std::filesystem::path& path);
+
+  ~InputRecorder();
+
+  InputRecorder(const InputRecorder&) = delete;
+  InputRecorder& operator=(const InputRecorder&) = delete;
+
+  void number(uint32_t reg, int64_t value);
+
+  void string(uint32_t reg, const std::string& value);
+
+  void draw(uint64_t value);
+
+  void pick(uint64_t index);
+
+  // Bytes logged so far, magic included
+  uint64_t position() const;
+
+  // Hands over whatever is buffered, as at the end of a run
+  void flush();
+
+private:
+  static constexpr size_t flushSize = 1 << 20;
+
+  void varint(uint64_t value);
+
+  void commit();
+
+  std::filesystem::path path;
+  std::string buffer;
+  uint64_t flushed;
+  std::ofstream stream;
+};
+
+// Throws Error when the run asks for something other than what was recorded
+class InputReplayer
+{
+public:
+  explicit InputReplayer(const std::filesystem::path& path);
+
+  // Returns Number or String; read the value with number() or string()
+  InputRecord registerRead(uint32_t reg);
+
+  int64_t number();
+
+  std::string string();
+
+  uint64_t draw();
+
+  uint64_t pick();
+
+  uint64_t position() const;
+
+  // Continues from a position() taken earlier, as when resuming a checkpoint
+  void seek(uint64_t position);
+
+private:
+  InputRecord record();
+
+  uint64_t varint();
+
+  std::string buffer;
+  size_t offset;
+};
+} // namespace epp
+
+#endif // EPP_REPLAY_HPP
@@ -0,0 +1,436 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+
+#include "epp.hpp"
+#include "trace.hpp"
+
+namespace epp
+{
+namespace
+{
+constexpr char traceMagic[8] = {'E', 'P', 'P', 'T', 'R', 'A', 'C', '2'};
+
+void writeString(std::ostream& rStream, const std::string& str)
+{
+  uint32_t size = static_cast<uint32_t>(str.size());
+  rStream.write(reinterpret_cast<const char*>(&size), sizeof(size));
+  rStream.write(str.data(), size);
+}
+
+template <typename T>
+T readPod(std::istream& rStream)
+{
+  T ret{};
+  if (!rStream.read(reinterpret_cast<char*>(&ret), sizeof(ret)))
+  {
+    throw Error("Trace is truncated");
+  }
+
+  return ret;
+}
+
+std::string readString(std::istream& rStream)
+{
+  std::string ret(readPod<uint32_t>(rStream), '\0');
+  if (!rStream.read(ret.data(), ret.size()))
+  {
+    throw Error("Trace is truncated");
+  }
+
+  return ret;
+}
+
+std::string jsonString(const std::string& str)
+{
+  std::string ret = "\"";
+
+  for (char c : str)
+  {
+    if (c == '"' || c == '\\')
+    {
+      ret += '\\';
+    }
+
+    if (static_cast<unsigned char>(c) >= 0x20)
+    {
+      ret += c;
+    }
+  }
+
+  ret += '"';
+  return ret;
+}
+} // namespace
+
+TraceWriter::TraceWriter(const std::filesystem::path& path, const std::vector<std::string>& nodeNames,
+  const std::vector<std::string>& programNames, const std::vector<int64_t>& channelIds)
+  : path(path),
+  ring(ringSize),
+  head(0),
+  tail(0),
+  stopping(false),
+  stream(path, std::ios::binary | std::ios::trunc),
+  drainer()
+{
+  if (!stream)
+  {
+    throw Error("Could not open trace file: " + path.string());
+  }
+
+  stream.write(traceMagic, sizeof(traceMagic));
+
+  uint32_t count = static_cast<uint32_t>(nodeNames.size());
+  stream.write(reinterpret_cast<const char*>(&count), sizeof(count));
+  for (const auto& rName : nodeNames)
+  {
+    writeString(stream, rName);
+  }
+
+  count = static_cast<uint32_t>(programNames.size());
+  stream.write(reinterpret_cast<const char*>(&count), sizeof(count));
+  for (const auto& rName : programNames)
+  {
+    writeString(stream, rName);
+  }
+
+  count = static_cast<uint32_t>(channelIds.size());
+  stream.write(reinterpret_cast<const char*>(&count), sizeof(count));
+  stream.write(reinterpret_cast<const char*>(channelIds.data()), channelIds.size() * sizeof(int64_t));
+
+  drainer = std::thread(&TraceWriter::drain, this);
+}
+
+TraceWriter::~TraceWriter()
+{
+  stop();
+}
+
+void TraceWriter::record(TraceEventType type, uint64_t cycle, uint32_t machine, uint32_t spawn, uint32_t node, uint32_t arg,
+  uint32_t extra)
+{
+  size_t slot = head.load(std::memory_order_relaxed);
+
+  // Only waits if the disk can't keep up with a full ring
+  while (slot - tail.load(std::memory_order_acquire) >= ringSize)
+  {
+    std::this_thread::yield();
+  }
+
+  TraceEvent& rEvent = ring[slot & (ringSize - 1)];
+  rEvent.cycle = cycle;
+  rEvent.machine = machine;
+  rEvent.spawn = spawn;
+  rEvent.node = node;
+  rEvent.arg = arg;
+  rEvent.extra = extra;
+  rEvent.type = type;
+  std::memset(rEvent.padding, 0, sizeof(rEvent.padding));
+
+  head.store(slot + 1, std::memory_order_release);
+}
+
+void TraceWriter::finish()
+{
+  if (!stop())
+  {
+    throw Error("Could not write trace file: " + path.string());
+  }
+}
+
+bool TraceWriter::stop()
+{
+  if (drainer.joinable())
+  {
+    stopping.store(true, std::memory_order_release);
+    drainer.join();
+    stream.close();
+  }
+
+  // A failed write or flush in the drain thread leaves the stream bad
+  return !stream.fail();
+}
+
+void TraceWriter::drain()
+{
+  while (true)
+  {
+    size_t first = tail.load(std::memory_order_relaxed);
+    size_t last = head.load(std::memory_order_acquire);
+
+    if (first == last)
+    {
+      if (stopping.load(std::memory_order_acquire))
+      {
+        // The run thread stops recording before it sets stopping
+        if (head.load(std::memory_order_acquire) == first)
+        {
+          break;
+        }
+
+        continue;
+      }
+
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+      continue;
+    }
+
+    while (first != last)
+    {
+      size_t start = first & (ringSize - 1);
+      size_t count = std::min(last - first, ringSize - start);
+      stream.write(reinterpret_cast<const char*>(&ring[start]), count * sizeof(TraceEvent));
+      first += count;
+    }
+
+    tail.store(last, std::memory_order_release);
+  }
+
+  stream.flush();
+}
+
+void convertTrace(std::istream& rIn, std::ostream& rOut)
+{
+  char magic[sizeof(traceMagic)];
+  if (!rIn.read(magic, sizeof(magic)) || std::memcmp(magic, traceMagic, sizeof(magic)) != 0)
+  {
+    throw Error("Not a trace file");
+  }
+
+  std::vector<std::string> nodeNames(readPod<uint32_t>(rIn));
+  for (auto& rName : nodeNames)
+  {
+    rName = readString(rIn);
+  }
+
+  std::vector<std::string> programNames(readPod<uint32_t>(rIn));
+  for (auto& rName : programNames)
+  {
+    rName = readString(rIn);
+  }
+
+  std::vector<int64_t> channelIds(readPod<uint32_t>(rIn));
+  for (auto& rId : channelIds)
+  {
+    rId = readPod<int64_t>(rIn);
+  }
+
+  auto channelName = [&](uint32_t channel)
+    {
+      if (channel < channelIds.size())
+      {
+        return channelIds[channel] == 0 ? std::string("global") : "global " + std::to_string(channelIds[channel]);
+      }
+
+      uint32_t node = channel - static_cast<uint32_t>(channelIds.size());
+      return node < nodeNames.size() ? nodeNames[node] : std::string("?");
+    };
+
+  struct Stay
+  {
+    uint32_t node;
+    uint64_t start;
+  };
+
+  struct Message
+  {
+    uint64_t flow;
+    uint32_t spawn;
+  };
+
+  // Mirrors each channel: values in the buffer, then senders still queued
+  struct ChannelMirror
+  {
+    std::deque<Message> buffer;
+    std::deque<Message> waiting;
+  };
+
+  // Keyed by spawn, as machine IDs are reused; spawns also serve as thread IDs
+  std::unordered_map<uint32_t, std::string> names;
+  std::unordered_map<uint32_t, Stay> stays;
+  std::unordered_map<uint32_t, ChannelMirror> channels;
+  std::unordered_map<uint32_t, uint32_t> queuedOn; // Spawn to channel it is queued on
+  uint64_t nextFlow = 0;
+  bool first = true;
+
+  auto begin = [&](const char* pPhase, uint32_t node, uint32_t spawn, uint64_t cycle)
+    {
+      rOut << (first ? "\n" : ",\n") << "{\"ph\":\"" << pPhase << "\",\"pid\":" << node << ",\"tid\":" << spawn << ",\"ts\":" << cycle;
+      first = false;
+    };
+
+  auto closeStay = [&](uint32_t spawn, uint64_t end)
+    {
+      auto iter = stays.find(spawn);
+      if (iter == stays.end())
+      {
+        return;
+      }
+
+      begin("X", iter->second.node, spawn, iter->second.start);
+      rOut << ",\"dur\":" << end - iter->second.start << ",\"name\":" << jsonString(names[spawn]) << ",\"cat\":\"exa\"}";
+      stays.erase(iter);
+    };
+
+  auto instant = [&](const TraceEvent& rEvent, const std::string& name, const std::string& detail)
+    {
+      begin("i", rEvent.node, rEvent.spawn, rEvent.cycle);
+      rOut << ",\"s\":\"t\",\"name\":" << jsonString(name) << ",\"cat\":\"exa\",\"args\":{\"exa\":" << jsonString(names[rEvent.spawn]);
+
+      if (!detail.empty())
+      {
+        rOut << ",\"detail\":" << jsonString(detail);
+      }
+
+      rOut << "}}";
+    };
+
+  auto flow = [&](const char* pPhase, uint32_t node, uint32_t spawn, uint64_t cycle, uint64_t id, const char* pCategory)
+    {
+      begin(pPhase, node, spawn, cycle);
+      rOut << ",\"id\":" << id << ",\"name\":\"" << pCategory << "\",\"cat\":\"" << pCategory << '"';
+
+      if (pPhase[0] == 'f')
+      {
+        rOut << ",\"bp\":\"e\"";
+      }
+
+      rOut << '}';
+    };
+
+  rOut << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+  for (uint32_t node = 0; node < nodeNames.size(); node++)
+  {
+    rOut << (first ? "\n" : ",\n") << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << node << ",\"args\":{\"name\":" << jsonString(nodeNames[node]) << "}}";
+    first = false;
+  }
+
+  TraceEvent event;
+  uint64_t lastCycle = 0;
+
+  while (rIn.read(reinterpret_cast<char*>(&event), sizeof(event)))
+  {
+    lastCycle = event.cycle;
+
+    switch (event.type)
+    {
+      case TraceEventType::Start:
+        names[event.spawn] = event.arg < programNames.size() ? programNames[event.arg] : "?";
+        stays[event.spawn] = {event.node, event.cycle};
+        break;
+      case TraceEventType::End:
+      {
+        static const char* const reasons[] = {"failed", "halt", "killed"};
+        instant(event, event.arg < 3 ? reasons[event.arg] : "end", "");
+        closeStay(event.spawn, event.cycle + 1);
+
+        auto queued = queuedOn.find(event.spawn);
+        if (queued != queuedOn.end())
+        {
+          auto& rWaiting = channels[queued->second].waiting;
+          for (auto iter = rWaiting.begin(); iter != rWaiting.end(); ++iter)
+          {
+            if (iter->spawn == event.spawn)
+            {
+              rWaiting.erase(iter);
+              break;
+            }
+          }
+
+          queuedOn.erase(queued);
+        }
+
+        break;
+      }
+      case TraceEventType::Link:
+      {
+        uint64_t id = nextFlow++;
+        closeStay(event.spawn, event.cycle + 1);
+        flow("s", event.node, event.spawn, event.cycle, id, "link");
+        flow("f", event.arg, event.spawn, event.cycle + 1, id, "link");
+        stays[event.spawn] = {event.arg, event.cycle + 1};
+        break;
+      }
+      case TraceEventType::Repl:
+        names[event.arg] = names[event.spawn] + ':' + std::to_string(event.extra);
+        instant(event, "repl", names[event.arg]);
+        stays[event.arg] = {event.node, event.cycle + 1};
+        break;
+      case TraceEventType::Kill:
+        instant(event, "kill", names[event.arg]);
+        break;
+      case TraceEventType::Send:
+      {
+        ChannelMirror& rChannel = channels[event.arg];
+
+        if (event.extra == 2)
+        {
+          // A queued value only now enters the channel; its flow began when it queued
+          if (!rChannel.waiting.empty())
+          {
+            queuedOn.erase(rChannel.waiting.front().spawn);
+            rChannel.buffer.push_back(rChannel.waiting.front());
+            rChannel.waiting.pop_front();
+          }
+
+          break;
+        }
+
+        Message message{nextFlow++, event.spawn};
+        flow("s", event.node, event.spawn, event.cycle, message.flow, "M");
+
+        if (event.extra)
+        {
+          rChannel.waiting.push_back(message);
+          queuedOn[event.spawn] = event.arg;
+        }
+        else
+        {
+          rChannel.buffer.push_back(message);
+        }
+
+        break;
+      }
+      case TraceEventType::Receive:
+      {
+        ChannelMirror& rChannel = channels[event.arg];
+
+        if (!rChannel.buffer.empty())
+        {
+          flow("f", event.node, event.spawn, event.cycle, rChannel.buffer.front().flow, "M");
+          rChannel.buffer.pop_front();
+        }
+
+        instant(event, "receive", channelName(event.arg));
+        break;
+      }
+      case TraceEventType::Grab:
+        instant(event, "grab", "file " + std::to_string(event.arg));
+        break;
+      case TraceEventType::Drop:
+        instant(event, "drop", "file " + std::to_string(event.arg));
+        break;
+      case TraceEventType::RunEnd:
+        break;
+    }
+  }
+
+  std::vector<uint32_t> open;
+  for (const auto& rPair : stays)
+  {
+    open.push_back(rPair.first);
+  }
+
+  for (uint32_t spawn : open)
+  {
+    closeStay(spawn, lastCycle + 1);
+  }
+
+  rOut << "\n]}\n";
+}
+} // namespace epp
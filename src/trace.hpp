@@ -0,0 +1,97 @@
+#ifndef EPP_TRACE_HPP
+#define EPP_TRACE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace epp
+{
+enum class TraceEventType : uint8_t
+{
+  Start, // Machine present when tracing began; arg is its program index
+  End, // Machine retired; arg is a TraceEndReason
+  Link, // arg is the destination node
+  Repl, // arg is the replica's spawn, extra its replica index
+  Kill, // arg is the victim's spawn
+  Send, // arg is the channel, extra is 1 if the sender had to queue, 2 when its queued value goes in
+  Receive, // arg is the channel
+  Grab, // arg is the file ID
+  Drop, // arg is the file ID
+  RunEnd // Marks the last cycle; no machine or node
+};
+
+enum class TraceEndReason : uint32_t
+{
+  Failure,
+  Halt,
+  Killed
+};
+
+// Channels are numbered with the global ones first, in Network::globalChannels
+// order, then one local channel per node. Machine IDs are reused once a machine
+// ends, so each machine is also given a spawn number, unique within the trace.
+struct TraceEvent
+{
+  uint64_t cycle;
+  uint32_t machine;
+  uint32_t spawn;
+  uint32_t node;
+  uint32_t arg;
+  uint32_t extra;
+  TraceEventType type;
+  uint8_t padding[3];
+};
+
+// Streams fixed-size events to a file. The run thread only copies events
+// into a single-producer ring; a background thread drains the ring to disk.
+// Write failures are reported by finish(), not the destructor.
+class TraceWriter
+{
+public:
+  // The header names nodes, programs and global channels for the converter
+  TraceWriter(const std::filesystem::path& path, const std::vector<std::string>& nodeNames,
+    const std::vector<std::string>& programNames, const std::vector<int64_t>& channelIds);
+
+  ~TraceWriter();
+
+  TraceWriter(const TraceWriter&) = delete;
+  TraceWriter& operator=(const TraceWriter&) = delete;
+
+  void record(TraceEventType type, uint64_t cycle, uint32_t machine, uint32_t spawn, uint32_t node, uint32_t arg = 0,
+    uint32_t extra = 0);
+
+  // Drains the ring and closes the file; throws Error if any write failed
+  void finish();
+
+private:
+  // Returns false if the file could not be written in full
+  bool stop();
+
+  void drain();
+
+  static constexpr size_t ringSize = 1 << 16;
+
+  std::filesystem::path path;
+  std::vector<TraceEvent> ring;
+  std::atomic<size_t> head; // Next slot the run thread fills
+  std::atomic<size_t> tail; // Next slot the drain thread writes out
+  std::atomic<bool> stopping;
+  std::ofstream stream;
+  std::thread drainer;
+};
+
+// Converts a binary trace to Chrome Trace Event JSON, viewable in
+// chrome://tracing or Perfetto. Nodes become processes, each stay of a
+// machine in a node becomes a slice (one cycle shown as one microsecond),
+// and LINK moves and M messages become flow arrows.
+void convertTrace(std::istream& rIn, std::ostream& rOut);
+} // namespace epp
+
+#endif // EPP_TRACE_HPP